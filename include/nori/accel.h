@@ -20,6 +20,12 @@ NORI_NAMESPACE_BEGIN
  * "Fast and Parallel Construction of SAH-based Bounding Volume Hierarchies"
  * by Ingo Wald (Proc. IEEE/EG Symposium on Interactive Ray Tracing, 2007)
  *
+ * When some of the meshes move over the shutter interval, the topology of
+ * the tree is built from bounds covering the entire motion, after which
+ * every node is refit with a pair of bounding boxes for the start and end
+ * of the shutter. Traversal interpolates these at the ray's time value,
+ * which keeps the tested boxes tight instead of using the union bounds.
+ *
  * \author Wenzel Jakob
  */
 class Accel {
@@ -35,7 +41,7 @@ public:
     void clear();
     
     /**
-     * \brief Register a triangle mesh for inclusion in the BVH.
+     * \brief Register a mesh (or another shape) for inclusion in the BVH.
      *
      * This function can only be used before \ref build() is called
      */
@@ -65,8 +71,11 @@ public:
     /// Return the total number of meshes registered with the BVH
     uint32_t getMeshCount() const { return (uint32_t) m_meshes.size(); }
     
-    /// Return the total number of internally represented triangles
-    uint32_t getTriangleCount() const { return m_meshOffset.back(); }
+    /// Return the total number of internally represented primitives
+    uint32_t getPrimitiveCount() const { return m_meshOffset.back(); }
+
+    /// Does the BVH contain moving geometry?
+    bool hasMotion() const { return !m_motionBounds.empty(); }
     
     /// Return one of the registered meshes
     Mesh *getMesh(uint32_t idx) { return m_meshes[idx]; }
@@ -90,13 +99,19 @@ protected:
         return (uint32_t) (it - m_meshOffset.begin());
     }
     
-    //// Return an axis-aligned bounding box containing the given triangle
+    //// Return an axis-aligned bounding box containing the given primitive
     BoundingBox3f getBoundingBox(uint32_t index) const {
         uint32_t meshIdx = findMesh(index);
         return m_meshes[meshIdx]->getBoundingBox(index);
     }
     
-    //// Return the centroid of the given triangle
+    //// Return an axis-aligned bounding box containing the given primitive at a specific time
+    BoundingBox3f getBoundingBox(uint32_t index, float time) const {
+        uint32_t meshIdx = findMesh(index);
+        return m_meshes[meshIdx]->getBoundingBox(index, time);
+    }
+    
+    //// Return the centroid of the given primitive
     Point3f getCentroid(uint32_t index) const {
         uint32_t meshIdx = findMesh(index);
         return m_meshes[meshIdx]->getCentroid(index);
@@ -104,6 +119,9 @@ protected:
     
     /// Compute internal tree statistics
     std::pair<float, uint32_t> statistics(uint32_t index = 0) const;
+
+    /// Compute the start/end-of-shutter bounds of a subtree (motion blur)
+    void refitMotionBounds(uint32_t index = 0);
     
     /* BVH node in 32 bytes */
     struct BVHNode {
@@ -146,9 +164,10 @@ protected:
     };
 private:
     std::vector<Mesh *> m_meshes;       ///< List of meshes registered with the BVH
-    std::vector<uint32_t> m_meshOffset; ///< Index of the first triangle for each shape
+    std::vector<uint32_t> m_meshOffset; ///< Index of the first primitive for each shape
     std::vector<BVHNode> m_nodes;       ///< BVH nodes
     std::vector<uint32_t> m_indices;    ///< Index references by BVH nodes
+    std::vector<BoundingBox3f> m_motionBounds; ///< Per-node bounds at shutter open/close (moving scenes only)
     BoundingBox3f m_bbox;               ///< Bounding box of the entire BVH
 };
 
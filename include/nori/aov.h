@@ -0,0 +1,112 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/color.h>
+#include <nori/vector.h>
+
+NORI_NAMESPACE_BEGIN
+
+struct Intersection;
+
+/**
+ * \brief Arbitrary output variables (AOVs) of a camera sample
+ *
+ * Integrators fill in this record with auxiliary information about
+ * the first visible surface while computing the radiance of a sample.
+ * All values are zero when the camera ray escapes the scene.
+ */
+struct AOVRecord {
+    /// Reflectance of the surface (see \ref BSDF::getAlbedo())
+    Color3f albedo;
+    /// World-space shading normal
+    Normal3f normal;
+    /// Distance along the camera ray
+    float depth;
+    /// World-space position
+    Point3f position;
+    /// Index of the mesh within the scene plus one (zero: no surface)
+    float objectID;
+    /// One if the camera ray hit a surface (filtering turns this into the pixel coverage)
+    float alpha;
+    /// Is this the first sample (sample index 0) of its pixel? Only that one records the object ID
+    bool firstSample;
+
+    /// Create an empty record
+    AOVRecord() { clear(); }
+
+    /// Reset all variables to zero
+    void clear() {
+        albedo = Color3f(0.0f);
+        normal = Normal3f(0.0f);
+        depth = 0.0f;
+        position = Point3f(0.0f);
+        objectID = 0.0f;
+        alpha = 0.0f;
+        firstSample = false;
+    }
+
+    /// Fill in the variables for a surface intersection found by a camera ray
+    void setSurface(const Intersection &its);
+};
+
+/**
+ * \brief Ordered list of the output variables that are rendered
+ *
+ * Parsed from a comma-separated list such as "albedo,normal,depth",
+ * which is given by the \c aovs property of the camera. Every variable
+ * is stored using one or more channels that are named following the
+ * conventions of multi-layer OpenEXR files:
+ *
+ * - \c albedo: albedo.R, albedo.G, albedo.B
+ * - \c normal: normal.X, normal.Y, normal.Z
+ * - \c depth: depth.Z
+ * - \c position: position.X, position.Y, position.Z
+ * - \c id: id.ID
+ * - \c alpha: A (the coverage, stored as the alpha channel of the image)
+ *
+ * The channels are filtered like the radiance, hence values along
+ * silhouettes are blended between the adjacent surfaces. The exception
+ * is the object ID, where a blend would name an unrelated object: each
+ * pixel stores the ID seen by its first sample, without any filtering.
+ * (This is not an antialiased matte -- use the coverage for that.)
+ */
+class AOVList {
+public:
+    /// Type of an output variable
+    enum EType { EAlbedo = 0, ENormal, EDepth, EPosition, EObjectID, EAlpha };
+
+    /// Create an empty list
+    AOVList() { }
+
+    /// Parse a comma-separated list of variable names
+    AOVList(const std::string &names);
+
+    /// Are there any variables in the list?
+    bool empty() const { return m_types.empty(); }
+
+    /// Return the total number of channels of all variables
+    int getChannelCount() const { return (int) m_channelNames.size(); }
+
+    /// Return the index of the first channel of a variable (or -1 if it is not rendered)
+    int getChannelIndex(EType type) const;
+
+    /// Return the names of the channels (in storage order)
+    const std::vector<std::string> &getChannelNames() const { return m_channelNames; }
+
+    /// Write the channels of all variables in \c rec to \c target
+    void write(const AOVRecord &rec, float *target) const;
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+
+protected:
+    std::vector<EType> m_types;
+    std::vector<std::string> m_channelNames;
+};
+
+NORI_NAMESPACE_END
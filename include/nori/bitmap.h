@@ -14,7 +14,10 @@ NORI_NAMESPACE_BEGIN
 /**
  * \brief Stores a RGB high dynamic-range bitmap
  *
- * The bitmap class provides I/O support using the OpenEXR file format
+ * The bitmap class provides I/O support using the OpenEXR file format.
+ * Besides the RGB data, a bitmap can hold any number of additional named
+ * single-channel layers (e.g. output variables such as normals or depth),
+ * which are written into the same multi-layer OpenEXR file.
  */
 class Bitmap : public Eigen::Array<Color3f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> {
 public:
@@ -29,14 +32,92 @@ public:
     Bitmap(const Vector2i &size = Vector2i(0, 0))
         : Base(size.y(), size.x()) { }
 
-    /// Load an OpenEXR file with the specified filename
+    /// Load an OpenEXR file with the specified filename (including any additional channels)
     Bitmap(const std::string &filename);
 
-    /// Save the bitmap as an EXR file with the specified filename
-    void saveEXR(const std::string &filename);
+    /// Compression methods for OpenEXR files
+    enum ECompression { ENoCompression = 0, EZIP, EPIZ, EDWAA };
 
-    /// Save the bitmap as a PNG file (with sRGB tonemapping) with the specified filename
+    /**
+     * \brief Save the bitmap as an EXR file with the specified filename
+     *
+     * The file is compressed using OpenEXR's global thread pool (see
+     * \c Imf::setGlobalThreadCount()). DWAA is lossy, the others are lossless.
+     */
+    void saveEXR(const std::string &filename, ECompression compression = EZIP);
+
+    /**
+     * \brief Save the bitmap as a PNG file (with sRGB tonemapping) with the specified filename
+     *
+     * The rows are converted to sRGB in parallel.
+     */
     void savePNG(const std::string &filename);
+
+    /// Parse the name of a compression method ("none", "zip", "piz" or "dwaa")
+    static ECompression parseCompression(const std::string &name);
+
+    /**
+     * \brief Replace all pixels outside of a rectangular region
+     * by those of \c base (which must have the same size)
+     *
+     * This is used to insert a re-rendered crop window into a previously
+     * rendered image. Additional channels are matched by name.
+     */
+    void composite(const Bitmap &base, const Point2i &offset, const Vector2i &size);
+
+    /**
+     * \brief Add a partial image (see \ref ImageBlock::toUnnormalizedBitmap())
+     *
+     * \return \c false if the sizes or channels of the bitmaps don't match
+     */
+    bool accumulate(const Bitmap &partial);
+
+    /**
+     * \brief Divide a (sum of) partial image(s) by its \c filterWeight
+     * channel and return the result without that channel
+     *
+     * Object ID channels (<tt>*.ID</tt>) aren't filtered and therefore
+     * kept as they are.
+     */
+    Bitmap *normalize() const;
+
+    /// Additional named channel stored along with the RGB data
+    struct Channel {
+        std::string name;
+        Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> data;
+        bool half = false;   ///< Store with 16 bit precision in OpenEXR files?
+    };
+
+    /**
+     * \brief Add a channel with the given name (e.g. "normal.X")
+     *
+     * The channel has the size of the bitmap and its contents are initially
+     * undefined. The returned reference is valid until the next call.
+     */
+    Channel &addChannel(const std::string &name);
+
+    /// Return the additional channels
+    const std::vector<Channel> &getChannels() const { return m_channels; }
+
+    /// Return the additional channels
+    std::vector<Channel> &getChannels() { return m_channels; }
+
+    /**
+     * \brief Store the RGB channels with 16 bit precision in OpenEXR files?
+     *
+     * Half floats cover the range of (unclamped) radiance values well and
+     * halve the file size. The precision of additional channels is set
+     * per channel (see \ref Channel::half). Files that are loaded retain
+     * the precision that they were stored with.
+     */
+    void setHalf(bool half) { m_half = half; }
+
+    /// Are the RGB channels stored with 16 bit precision in OpenEXR files?
+    bool isHalf() const { return m_half; }
+
+protected:
+    std::vector<Channel> m_channels;
+    bool m_half = false;
 };
 
 NORI_NAMESPACE_END
@@ -12,9 +12,15 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
+#include <nori/aov.h>
+#include <nori/bbox.h>
 #include <tbb/mutex.h>
+#include <tbb/spin_mutex.h>
+#include <atomic>
+#include <memory>
 
-#define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
+#define NORI_BLOCK_SIZE 32 /* Default block size used for parallelization */
+#define NORI_DIRTY_TILE_SIZE 64 /* Granularity of the tracking of modified regions */
 
 NORI_NAMESPACE_BEGIN
 
@@ -31,6 +37,10 @@ NORI_NAMESPACE_BEGIN
  * this region. For that reason, this class also stores information about
  * a small border region around the rectangle, whose size depends on the
  * properties of the reconstruction filter.
+ *
+ * Optionally, the block also accumulates arbitrary output variables
+ * (see \ref AOVList), which are filtered using the same weights as the
+ * radiance and stored in a separate array with one float per channel.
  */
 class ImageBlock : public Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> {
 public:
@@ -41,8 +51,11 @@ public:
      * \param filter
      *     Samples will be convolved with the image reconstruction
      *     filter provided here.
+     * \param aovs
+     *     Output variables that are accumulated along with the radiance
      */
-    ImageBlock(const Vector2i &size, const ReconstructionFilter *filter);
+    ImageBlock(const Vector2i &size, const ReconstructionFilter *filter,
+               const AOVList &aovs = AOVList());
     
     /// Release all memory
     ~ImageBlock();
@@ -62,32 +75,168 @@ public:
     /// Return the border size in pixels
     inline int getBorderSize() const { return m_borderSize; }
 
+    /// Return the output variables that are accumulated by this block
+    inline const AOVList &getAOVs() const { return m_aovs; }
+
+    /**
+     * \brief Return the normalized value of an output variable channel
+     *
+     * The pixel position is relative to the block (excluding the border).
+     * The object ID is stored unfiltered and returned as is.
+     */
+    float getAOV(int x, int y, int channel) const {
+        float value = m_aovData(y + m_borderSize, (x + m_borderSize) * m_aovChannels + channel);
+        if (channel == m_idChannel)
+            return value;
+        float weight = coeff(y + m_borderSize, x + m_borderSize).w();
+        return weight != 0 ? value / weight : 0.0f;
+    }
+
     /**
      * \brief Turn the block into a proper bitmap
      * 
      * This entails normalizing all pixels and discarding
-     * the border region.
+     * the border region. Output variables are added to the
+     * bitmap as additional named channels.
      */
     Bitmap *toBitmap() const;
 
+    /**
+     * \brief Turn the block into a bitmap without normalizing it
+     *
+     * The weighted sums of the pixels (and output variables) are stored
+     * along with an additional \c filterWeight channel. Adding up such
+     * bitmaps of disjoint sets of blocks and then dividing by the summed
+     * weights yields exactly the normalized image (see \c nori-merge).
+     * The unfiltered object ID channel is stored as is.
+     */
+    Bitmap *toUnnormalizedBitmap() const;
+
     /// Convert a bitmap into an image block
     void fromBitmap(const Bitmap &bitmap);
 
     /// Clear all contents
-    void clear() { setConstant(Color4f()); }
+    void clear() { setConstant(Color4f()); m_aovData.setZero(); markDirty(Point2i(0, 0), Point2i(cols(), rows())); }
+
+    /**
+     * \brief Record a sample with the given position and radiance value
+     *
+     * When the block stores output variables, they are taken from \c aov
+     * (or treated as zero if no record is given).
+     */
+    void put(const Point2f &pos, const Color3f &value, const AOVRecord *aov = nullptr);
+
+    /**
+     * \brief Record a batch of samples with the given positions and radiance values
+     *
+     * Equivalent to calling \ref put(const Point2f &, const Color3f &) for
+     * every sample in sequence (and produces bit-identical results), but
+     * the pixel footprints and filter weights of all samples are computed
+     * up front in tight loops over arrays, which the compiler vectorizes.
+     * Output variables are not supported by this function.
+     */
+    void put(const Point2f *positions, const Color3f *values, size_t count);
+
+    /// Is the filter importance sampled instead of splatting samples?
+    bool isFilterImportanceSampled() const { return m_filterCDF != nullptr; }
+
+    /**
+     * \brief Sample the offset of an image sample from its pixel center
+     * proportionally to the (absolute value of the) reconstruction filter
+     *
+     * Only available when \ref isFilterImportanceSampled() is \c true. The
+     * sample must then be recorded using \ref put(const Point2i &, const Color3f &, float)
+     * for the pixel it was generated for, and with the returned weight. The
+     * weight is +1 or -1, since negative filter lobes are sampled according to
+     * their magnitude.
+     */
+    Point2f sampleFilter(const Point2f &sample, float &weight) const;
 
-    /// Record a sample with the given position and radiance value
-    void put(const Point2f &pos, const Color3f &value);
+    /// Record a sample that only contributes to the given pixel (filter importance sampling)
+    void put(const Point2i &pixel, const Color3f &value, float weight,
+             const AOVRecord *aov = nullptr);
 
     /**
      * \brief Merge another image block into this one
      *
-     * During the merge operation, this function locks 
-     * the destination block using a mutex.
+     * This function is designed to be called concurrently by many threads
+     * without serializing them on a global lock. Blocks that are merged at
+     * the same time must have disjoint (unbordered) regions, as is the case
+     * for the blocks of a \ref BlockGenerator. Pixels further than twice
+     * the border size from the edge of \c b then cannot receive
+     * contributions from any other block and are added without locking.
+     * The remaining ring of pixels, which overlaps the neighboring blocks,
+     * is added under one of several spin locks that each protect a band of
+     * rows of the destination block. Blocks that are at most twice as wide
+     * as the border have no such interior and are added entirely under
+     * these locks.
      */
     void put(ImageBlock &b);
 
-    /// Lock the image block (using an internal mutex)
+    /**
+     * \brief Add the part of another block that overlaps this one
+     *
+     * Both blocks may be located anywhere in the image; the overlap of
+     * their regions including the borders is added. Unlike
+     * \ref put(ImageBlock &), this function does no locking.
+     */
+    void add(const ImageBlock &b);
+
+    /// Write the raw (unnormalized) contents, including the border and output variables
+    void serialize(std::ostream &stream) const;
+
+    /// Read contents written by \ref serialize() (the layout must match)
+    void unserialize(std::istream &stream);
+
+    /**
+     * \brief Return the regions that were modified since the last call
+     *
+     * Modifications by \ref put(ImageBlock &), \ref add(), \ref clear(),
+     * \ref fromBitmap() and \ref unserialize() are tracked in tiles of
+     * NORI_DIRTY_TILE_SIZE^2 pixels. This allows an observer (the preview
+     * window) to copy only what changed from the snapshot (see
+     * \ref readSnapshot()), without holding up the render threads.
+     *
+     * The tiles are marked as clean before they are returned. If a tile is
+     * modified while the caller reads it, it is therefore returned again by
+     * the next call.
+     *
+     * \return The tiles in storage coordinates (including the border),
+     *     where \c max is exclusive
+     */
+    std::vector<BoundingBox2i> fetchDirtyTiles() const;
+
+    /**
+     * \brief Keep a second copy of the pixels that can be read while
+     * other threads are merging blocks (double buffering)
+     *
+     * Every modification then copies the changed region into the snapshot
+     * while holding the locks of its rows (see \ref put(ImageBlock &)).
+     * This costs the memory of a second image (without output variables).
+     * Must be called before any concurrent use of the block.
+     */
+    void enableSnapshot();
+
+    /**
+     * \brief Copy a region of the snapshot into \c target (one row after
+     * the other, without gaps)
+     *
+     * Safe to call while other threads modify the block. Each row is
+     * consistent; rows that were modified in the meantime are reported
+     * again by \ref fetchDirtyTiles().
+     *
+     * \param region
+     *     Region in storage coordinates (including the border), where
+     *     \c max is exclusive
+     */
+    void readSnapshot(const BoundingBox2i &region, Color4f *target) const;
+
+    /**
+     * \brief Lock the image block (using an internal mutex)
+     *
+     * Note that \ref put(ImageBlock &) doesn't take this lock, hence it
+     * only guards against other users of \ref lock().
+     */
     inline void lock() const { m_mutex.lock(); }
     
     /// Unlock the image block
@@ -100,55 +249,194 @@ protected:
     Vector2i m_size;
     int m_borderSize = 0;
     float *m_filter = nullptr;
+    float *m_filterCDF = nullptr;
     float m_filterRadius = 0;
     float *m_weightsX = nullptr;
     float *m_weightsY = nullptr;
     float m_lookupFactor = 0;
+    std::vector<float> m_batchPos;       ///< Scratch space for batched splatting
+    std::vector<int> m_batchBounds;      ///< Scratch space for batched splatting
+    std::vector<float> m_batchWeights;   ///< Scratch space for batched splatting
+    AOVList m_aovs;
+    int m_aovChannels = 0;
+    int m_idChannel = -1;                ///< Channel of the (unfiltered) object ID, if any
+    /// Weighted output variables (one row per row of pixels, \c m_aovChannels floats per pixel)
+    Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> m_aovData;
+    std::vector<float> m_aovValues;      ///< Channels of the sample being recorded
     mutable tbb::mutex m_mutex;
+    std::unique_ptr<tbb::spin_mutex[]> m_rowLocks; ///< Locks for bands of rows (see \ref put(ImageBlock &))
+    Vector2i m_dirtyTiles;                         ///< Number of tiles tracked by \ref fetchDirtyTiles()
+    mutable std::unique_ptr<std::atomic<uint8_t>[]> m_dirty;
+    /// Copy of the pixels for concurrent readers (empty unless \ref enableSnapshot() was called)
+    Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> m_snapshot;
+
+    /// Copy a modified storage region (\c max is exclusive) into the snapshot
+    void updateSnapshot(const Point2i &min, const Point2i &max);
+
+    /// Mark the tiles overlapping the given storage region (\c max is exclusive) as modified
+    void markDirty(const Point2i &min, const Point2i &max) {
+        if ((max.array() <= min.array()).any())
+            return;
+        if (m_snapshot.size() > 0)
+            updateSnapshot(min, max);
+        for (int y = min.y() / NORI_DIRTY_TILE_SIZE; y <= (max.y() - 1) / NORI_DIRTY_TILE_SIZE; ++y)
+            for (int x = min.x() / NORI_DIRTY_TILE_SIZE; x <= (max.x() - 1) / NORI_DIRTY_TILE_SIZE; ++x)
+                m_dirty[y * m_dirtyTiles.x() + x].store(1, std::memory_order_release);
+    }
 };
 
 /**
- * \brief Spiraling block generator
+ * \brief Per-pixel sample statistics for adaptive sampling
+ *
+ * Stored next to the \ref ImageBlock of the full image, this buffer
+ * records the number of samples taken in every pixel, along with the sum
+ * and the sum of squares of their luminance. From these, the relative
+ * standard error of the pixel estimate can be computed, which drives the
+ * decision whether a pixel needs further samples.
+ *
+ * Each pixel is only written by the thread that renders the block
+ * containing it, hence no locking is necessary.
+ */
+class MomentBuffer {
+public:
+    /// Create an empty buffer for an image of the given size
+    MomentBuffer(const Vector2i &size);
+
+    /// Return the size of the image
+    const Vector2i &getSize() const { return m_size; }
+
+    /// Record a sample with the given luminance in the specified pixel
+    void put(const Point2i &pixel, float luminance) {
+        Moments &m = m_moments[pixel.y() * m_size.x() + pixel.x()];
+        m.count++;
+        m.sum += luminance;
+        m.sumSq += (double) luminance * luminance;
+    }
+
+    /// Return the number of samples that were taken in the specified pixel
+    uint32_t getSampleCount(const Point2i &pixel) const {
+        return m_moments[pixel.y() * m_size.x() + pixel.x()].count;
+    }
+
+    /**
+     * \brief Return the relative standard error of the mean of a pixel
+     *
+     * To prevent dark pixels from never converging, the mean luminance
+     * in the denominator is clamped to a small minimum value.
+     */
+    float getRelativeError(const Point2i &pixel) const;
+
+    /// Return the variance of the mean luminance of a pixel (infinite with less than two samples)
+    float getVariance(const Point2i &pixel) const;
+
+    /// Return the total number of samples taken
+    uint64_t getTotalSampleCount() const;
+
+    /// Return a bitmap containing the per-pixel sample counts
+    Bitmap *toBitmap() const;
+
+    /// Write the statistics of all pixels to a stream
+    void serialize(std::ostream &stream) const;
+
+    /// Read statistics written by \ref serialize() (the size must match)
+    void unserialize(std::istream &stream);
+
+protected:
+    struct Moments {
+        uint32_t count = 0;
+        double sum = 0, sumSq = 0;
+    };
+
+    Vector2i m_size;
+    std::vector<Moments> m_moments;
+};
+
+/**
+ * \brief Block generator
  *
  * This class can be used to chop up an image into many small
- * rectangular blocks suitable for parallel rendering. The blocks
- * are ordered in spiraling pattern so that the center is
- * rendered first.
+ * rectangular blocks suitable for parallel rendering. The order of the
+ * blocks is computed once when the generator is created: by default,
+ * they are ordered in spiraling pattern so that the center is rendered
+ * first; a Hilbert curve or plain scanline order are also available.
+ *
+ * Blocks are handed out using an atomic counter, so that \ref next() never
+ * blocks. To reduce the tail latency at the end of a frame (where a few
+ * expensive blocks may keep some threads busy while the others are idle),
+ * the last blocks of the sequence are split into four smaller sub-blocks.
+ *
+ * The generator can also be restricted to a rectangular region of the
+ * image (a crop window), in which case the blocks are aligned to the
+ * upper left corner of that region.
  */
 class BlockGenerator {
 public:
+    /// Order in which the blocks are handed out
+    enum EBlockOrder { ESpiral = 0, EHilbert, EScanline };
+
     /**
      * \brief Create a block generator with
      * \param size
-     *      Size of the image that should be split into blocks
+     *      Size of the image (or region) that should be split into blocks
      * \param blockSize
      *      Maximum size of the individual blocks
+     * \param order
+     *      Order in which the blocks are returned
+     * \param splitTail
+     *      Number of blocks at the end of the sequence that are split
+     *      into four sub-blocks (-1: one per hardware thread)
+     * \param offset
+     *      Position of the region within the image
      */
-    BlockGenerator(const Vector2i &size, int blockSize);
-    
+    BlockGenerator(const Vector2i &size, int blockSize,
+                   EBlockOrder order = ESpiral, int splitTail = -1,
+                   const Point2i &offset = Point2i(0, 0));
+
     /**
      * \brief Return the next block to be rendered
      *
-     * This function is thread-safe
+     * This function is thread-safe and lock-free
      *
      * \return \c false if there were no more blocks
      */
     bool next(ImageBlock &block);
 
     /// Return the total number of blocks
-    int getBlockCount() const { return m_blocksLeft; }
+    int getBlockCount() const { return (int) m_blocks.size(); }
+
+    /**
+     * \brief Only keep every <tt>count</tt>-th block of the sequence, starting at \c index
+     *
+     * This splits the image among several processes. Interleaving the
+     * blocks balances the work, since neighboring blocks tend to have
+     * similar cost. All processes must use the same block sequence, so
+     * tail splitting must not depend on the machine (e.g. \c splitTail = 0).
+     */
+    void shard(int index, int count);
+
+    /// Return the maximum size of a block
+    int getBlockSize() const { return m_blockSize; }
+
+    /// Parse the name of a block order ("spiral", "hilbert" or "scanline")
+    static EBlockOrder parseOrder(const std::string &name);
 protected:
     enum EDirection { ERight = 0, EDown, ELeft, EUp };
 
-    Point2i m_block;
+    /// Append the block at the given grid position (unless it lies outside)
+    void addBlock(const Point2i &block);
+
+    /// Block offset and size
+    struct Block {
+        Point2i offset;
+        Vector2i size;
+    };
+
     Vector2i m_numBlocks;
+    Point2i m_offset;
     Vector2i m_size;
     int m_blockSize;
-    int m_numSteps;
-    int m_blocksLeft;
-    int m_stepsLeft;
-    int m_direction;
-    tbb::mutex m_mutex;
+    std::vector<Block> m_blocks;
+    std::atomic<int> m_next;
 };
 
 NORI_NAMESPACE_END
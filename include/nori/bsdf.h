@@ -98,6 +98,14 @@ public:
      * or not to store photons on a surface
      */
     virtual bool isDiffuse() const { return false; }
+
+    /**
+     * \brief Return the (approximate) reflectance of the surface at an intersection
+     *
+     * This is used for the albedo output variable, e.g. to guide a denoiser.
+     * The default of one is appropriate for specular materials.
+     */
+    virtual Color3f getAlbedo(const Intersection &) const { return Color3f(1.0f); }
 };
 
 NORI_NAMESPACE_END
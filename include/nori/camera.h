@@ -7,6 +7,7 @@
 #pragma once
 
 #include <nori/object.h>
+#include <nori/aov.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -45,12 +46,37 @@ public:
         const Point2f &samplePosition,
         const Point2f &apertureSample) const = 0;
 
+    /**
+     * \brief Move the camera (used to render camera animations
+     * without reloading the scene)
+     */
+    virtual void setCameraToWorld(const Transform &) {
+        throw NoriException("This camera doesn't support changing its transformation!");
+    }
+
     /// Return the size of the output image in pixels
     const Vector2i &getOutputSize() const { return m_outputSize; }
 
+    /// Return the upper left corner of the region that is rendered (crop window)
+    const Point2i &getCropOffset() const { return m_cropOffset; }
+
+    /// Return the size of the region that is rendered (crop window)
+    const Vector2i &getCropSize() const { return m_cropSize; }
+
     /// Return the camera's reconstruction filter in image space
     const ReconstructionFilter *getReconstructionFilter() const { return m_rfilter; }
 
+    /// Return the output variables that are rendered along with the radiance
+    const AOVList &getAOVs() const { return m_aovs; }
+
+    /**
+     * \brief Map a uniformly distributed sample to a time value
+     * within the camera's shutter interval (used for motion blur)
+     */
+    float sampleTime(float sample) const {
+        return m_shutterOpen + sample * (m_shutterClose - m_shutterOpen);
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Camera/etc.) 
      * provided by this instance
@@ -58,7 +84,12 @@ public:
     EClassType getClassType() const { return ECamera; }
 protected:
     Vector2i m_outputSize;
+    Point2i m_cropOffset;
+    Vector2i m_cropSize;
     ReconstructionFilter *m_rfilter;
+    float m_shutterOpen = 0.0f;
+    float m_shutterClose = 1.0f;
+    AOVList m_aovs;
 };
 
 NORI_NAMESPACE_END
@@ -0,0 +1,41 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/transform.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Sequence of camera-to-world transformations, one per frame
+ *
+ * The path is read from a text file with one frame per line, given either
+ * as a look-at transformation (with the same meaning as the \c lookat tag
+ * of the scene description) or as the 16 entries of a row-major matrix:
+ *
+ * <pre>
+ *   # Comments and empty lines are ignored
+ *   lookat originX originY originZ targetX targetY targetZ upX upY upZ
+ *   matrix m00 m01 m02 m03 m10 ... m33
+ * </pre>
+ */
+class CameraPath {
+public:
+    /// Load a camera path from the given file
+    CameraPath(const std::string &filename);
+
+    /// Return the number of frames
+    size_t size() const { return m_frames.size(); }
+
+    /// Return the camera-to-world transformation of a frame
+    const Transform &operator[](size_t frame) const { return m_frames[frame]; }
+
+protected:
+    std::vector<Transform> m_frames;
+};
+
+NORI_NAMESPACE_END
@@ -0,0 +1,69 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/block.h>
+#include <thread>
+#include <atomic>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Periodic snapshots of a progressive render, which allow
+ * resuming it after the process was interrupted
+ *
+ * A checkpoint contains the (unnormalized) accumulation buffer, the
+ * per-pixel sample statistics (if any), the number of samples per pixel
+ * that were taken and the number of completed passes. The samplers need
+ * no further state: they derive their random numbers from the pixel and
+ * the sample index, hence a resumed render continues with fresh samples
+ * exactly as if it had never stopped.
+ *
+ * Snapshots are serialized in memory by the caller and then written to
+ * disk by a background thread, first into a temporary file that then
+ * replaces the previous checkpoint. A crash during the write therefore
+ * never destroys the last valid checkpoint. (Except on Windows, where the
+ * previous checkpoint is removed right before the renaming.)
+ */
+class Checkpoint {
+public:
+    /// Create a checkpoint that is stored in the given file
+    Checkpoint(const std::string &filename) : m_filename(filename), m_busy(false) { }
+
+    /// Wait for a pending write to finish
+    ~Checkpoint() { wait(); }
+
+    /**
+     * \brief Take a snapshot of the render state and write it in the background
+     *
+     * \return \c false if the previous snapshot is still being written, in
+     *    which case this one is skipped to avoid stalling the caller
+     */
+    bool save(const ImageBlock &result, const MomentBuffer *moments,
+              uint64_t sampleCount, int passes);
+
+    /**
+     * \brief Restore the render state from the file
+     *
+     * \return \c false if there is no checkpoint
+     */
+    bool load(ImageBlock &result, MomentBuffer *moments,
+              uint64_t &sampleCount, int &passes) const;
+
+    /// Wait for a pending write to finish
+    void wait();
+
+    /// Return the name of the checkpoint file
+    const std::string &getFilename() const { return m_filename; }
+
+protected:
+    std::string m_filename;
+    std::thread m_thread;
+    std::atomic<bool> m_busy;
+};
+
+NORI_NAMESPACE_END
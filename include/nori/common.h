@@ -119,10 +119,12 @@ typedef TRayDifferential<Point2f, Vector2f> RayDifferential2f;
 typedef TRayDifferential<Point3f, Vector3f> RayDifferential3f;
 
 /// Some more forward declarations
+struct AOVRecord;
 class BSDF;
 class Bitmap;
 class BlockGenerator;
 class Camera;
+class Denoiser;
 class ImageBlock;
 class Integrator;
 class KDTree;
@@ -136,6 +138,7 @@ class PhaseFunction;
 class ReconstructionFilter;
 class Sampler;
 class Scene;
+struct Transform;
 
 /// Import cout, cerr, endl for debugging purposes
 using std::cout;
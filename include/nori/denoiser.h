@@ -0,0 +1,49 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/object.h>
+
+NORI_NAMESPACE_BEGIN
+
+class MomentBuffer;
+
+/**
+ * \brief Abstract denoiser (a post-process that removes Monte Carlo noise)
+ *
+ * A denoiser is specified in the scene description using the
+ * <tt>&lt;denoiser type="..."&gt;</tt> tag and runs over the finished
+ * image before it is written to disk. Denoisers can use the output
+ * variables stored in the image block (see the \c aovs property of the
+ * camera) to preserve edges and texture detail.
+ */
+class Denoiser : public NoriObject {
+public:
+    /// Release all memory
+    virtual ~Denoiser() { }
+
+    /**
+     * \brief Denoise the radiance stored in \c image (in place)
+     *
+     * \param image
+     *    The image block of the entire image. Only the radiance values
+     *    are modified; their filter weights are preserved so that the
+     *    output variables remain correctly normalized.
+     * \param moments
+     *    Per-pixel sample statistics, if they were recorded (e.g. for
+     *    adaptive sampling), otherwise \c nullptr
+     */
+    virtual void denoise(ImageBlock &image, const MomentBuffer *moments) const = 0;
+
+    /**
+     * \brief Return the type of object (i.e. Mesh/BSDF/etc.)
+     * provided by this instance
+     * */
+    EClassType getClassType() const { return EDenoiser; }
+};
+
+NORI_NAMESPACE_END
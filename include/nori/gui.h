@@ -6,21 +6,32 @@
 
 #pragma once
 
-#include <nori/common.h>
+#include <nori/color.h>
+#include <nori/stats.h>
 #include <nanogui/screen.h>
+#include <nanogui/label.h>
 
 NORI_NAMESPACE_BEGIN
 
 class NoriScreen : public nanogui::Screen {
 public:
+    /// Show \c block, which must keep a snapshot (see \ref ImageBlock::enableSnapshot())
     NoriScreen(const ImageBlock &block);
     void draw_contents() override;
 private:
+    /// Refresh the performance overlay from the render statistics
+    void updateStatistics();
+
     const ImageBlock &m_block;
     nanogui::ref<nanogui::Shader> m_shader;
     nanogui::ref<nanogui::Texture> m_texture;
     nanogui::ref<nanogui::RenderPass> m_renderPass;
+    std::vector<Color4f> m_staging;  ///< Copy of a modified tile that is being uploaded
     float m_scale = 1.f;
+    nanogui::Widget *m_statsPanel;
+    nanogui::Label *m_samplesLabel, *m_raysLabel, *m_progressLabel;
+    std::vector<nanogui::Label *> m_threadLabels;
+    Statistics::Snapshot m_lastStats;
 };
 
 NORI_NAMESPACE_END
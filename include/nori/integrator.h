@@ -41,6 +41,35 @@ public:
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Sample the incident radiance along a camera ray and
+     * record the output variables of its first visible surface
+     *
+     * The default implementation intersects the ray with the scene to
+     * fill in \c aov and then calls the function above. Integrators
+     * override it to obtain the variables from their own first
+     * intersection instead, which avoids tracing the ray twice.
+     */
+    virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                       AOVRecord &aov) const;
+
+    /**
+     * \brief Render all samples of an image block at once (optional)
+     *
+     * Integrators that process many paths together (e.g. in a wavefront
+     * fashion) can override this function to take over the sample loop
+     * of a block. It must generate \c sampleCount camera samples per pixel
+     * (drawing the camera dimensions from \c sampler) and splat their
+     * radiance into the (already cleared) \c block, along with the
+     * output variables if the block stores any.
+     *
+     * \return \c false if the integrator doesn't support this, in which
+     *    case the renderer calls \ref Li() for every sample
+     */
+    virtual bool renderBlock(const Scene *, Sampler *, ImageBlock &, uint32_t) const {
+        return false;
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
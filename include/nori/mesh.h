@@ -34,9 +34,11 @@ struct Intersection {
     Frame geoFrame;
     /// Pointer to the associated mesh
     const Mesh *mesh;
+    /// Time value of the ray that produced the intersection
+    float time;
 
     /// Create an uninitialized intersection record
-    Intersection() : mesh(nullptr) { }
+    Intersection() : mesh(nullptr), time(0.f) { }
 
     /// Transform a direction vector into the local shading frame
     Vector3f toLocal(const Vector3f &d) const {
@@ -48,6 +50,18 @@ struct Intersection {
         return shFrame.toWorld(d);
     }
 
+    /// Spawn a ray leaving the intersection in direction \c d (at the same time)
+    Ray3f spawnRay(const Vector3f &d) const {
+        return Ray3f(p, d, Epsilon, std::numeric_limits<float>::infinity(), time);
+    }
+
+    /// Spawn a shadow ray from the intersection towards the position \c target
+    Ray3f spawnRayTo(const Point3f &target) const {
+        Vector3f d = target - p;
+        float dist = d.norm();
+        return Ray3f(p, d / dist, Epsilon, dist - Epsilon, time);
+    }
+
     /// Return a human-readable summary of the intersection record
     std::string toString() const;
 };
@@ -59,6 +73,17 @@ struct Intersection {
  * for querying the individual triangles. Subclasses of \c Mesh implement
  * the specifics of how to create its contents (e.g. by loading from an
  * external file)
+ *
+ * The functions used by the acceleration data structure (primitive count,
+ * bounds, centroids, intersection and hit information) are virtual, which
+ * allows subclasses to provide primitives other than triangles (e.g.
+ * curves). The default implementations handle triangles.
+ *
+ * A mesh may optionally provide a second set of vertex positions (and
+ * normals) that describes its pose at the end of the shutter interval.
+ * Vertices then move linearly between the two keyframes, and all queries
+ * that take a time value interpolate accordingly (motion blur). Emitters
+ * can't move, since they are sampled in a single pose.
  */
 class Mesh : public NoriObject {
 public:
@@ -71,23 +96,46 @@ public:
     /// Return the total number of triangles in this shape
     uint32_t getTriangleCount() const { return (uint32_t) m_F.cols(); }
 
+    /// Return the total number of primitives that are inserted into the BVH
+    virtual uint32_t getPrimitiveCount() const { return getTriangleCount(); }
+
     /// Return the total number of vertices in this shape
     uint32_t getVertexCount() const { return (uint32_t) m_V.cols(); }
 
     /// Return the surface area of the given triangle
     float surfaceArea(uint32_t index) const;
 
-    /// Return the sum of all triangle surface area
-    float surfaceArea() const;
+    /// Return the total surface area of the shape
+    virtual float surfaceArea() const;
 
     //// Return an axis-aligned bounding box of the entire mesh
     const BoundingBox3f &getBoundingBox() const { return m_bbox; }
 
-    //// Return an axis-aligned bounding box containing the given triangle
-    BoundingBox3f getBoundingBox(uint32_t index) const;
+    //// Return an axis-aligned bounding box containing the given primitive (over the whole shutter interval)
+    virtual BoundingBox3f getBoundingBox(uint32_t index) const;
 
-    //// Return the centroid of the given triangle
-    Point3f getCentroid(uint32_t index) const;
+    //// Return an axis-aligned bounding box containing the given primitive at a specific time
+    virtual BoundingBox3f getBoundingBox(uint32_t index, float time) const;
+
+    //// Return the centroid of the given primitive (at the middle of the shutter interval)
+    virtual Point3f getCentroid(uint32_t index) const;
+
+    /// Does this mesh move over the shutter interval?
+    bool hasMotion() const { return m_V1.size() > 0; }
+
+    /// Return the position of a vertex at the given time
+    Point3f getVertexPosition(uint32_t index, float time) const {
+        if (!hasMotion())
+            return m_V.col(index);
+        return (1.0f - time) * m_V.col(index) + time * m_V1.col(index);
+    }
+
+    /// Return the (unnormalized) normal of a vertex at the given time
+    Normal3f getVertexNormal(uint32_t index, float time) const {
+        if (m_N1.size() == 0)
+            return m_N.col(index);
+        return (1.0f - time) * m_N.col(index) + time * m_N1.col(index);
+    }
 
     /** \brief Ray-triangle intersection test
      *
@@ -96,7 +144,8 @@ public:
      *
      * Note that the test only applies to a single triangle in the mesh.
      * An acceleration data structure like \ref BVH is needed to search
-     * for intersections against many triangles.
+     * for intersections against many triangles. Moving triangles are
+     * intersected in their pose at time <tt>ray.time</tt>.
      *
      * \param index
      *    Index of the triangle that should be intersected
@@ -114,7 +163,17 @@ public:
      * \return
      *   \c true if an intersection has been detected
      */
-    bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const;
+    virtual bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const;
+
+    /**
+     * \brief Fill in the intersection record for a hit found by \ref rayIntersect()
+     *
+     * On entry, <tt>its.t</tt> and <tt>its.uv</tt> contain the distance and
+     * the (u, v) values reported by \ref rayIntersect() for the primitive
+     * \c index. This function computes the position, texture coordinates
+     * and the geometric and shading frames.
+     */
+    virtual void setHitInformation(uint32_t index, const Ray3f &ray, Intersection &its) const;
 
     /// Return a pointer to the vertex positions
     const MatrixXf &getVertexPositions() const { return m_V; }
@@ -122,6 +181,12 @@ public:
     /// Return a pointer to the vertex normals (or \c nullptr if there are none)
     const MatrixXf &getVertexNormals() const { return m_N; }
 
+    /// Return the vertex positions at the end of the shutter interval (empty for static meshes)
+    const MatrixXf &getVertexPositionsEnd() const { return m_V1; }
+
+    /// Return the vertex normals at the end of the shutter interval (empty if they don't move)
+    const MatrixXf &getVertexNormalsEnd() const { return m_N1; }
+
     /// Return a pointer to the texture coordinates (or \c nullptr if there are none)
     const MatrixXf &getVertexTexCoords() const { return m_UV; }
 
@@ -146,6 +211,12 @@ public:
     /// Return the name of this mesh
     const std::string &getName() const { return m_name; }
 
+    /// Return the index of this mesh within the scene (used for object ID passes)
+    uint32_t getObjectID() const { return m_objectID; }
+
+    /// Set the index of this mesh within the scene
+    void setObjectID(uint32_t id) { m_objectID = id; }
+
     /// Return a human-readable summary of this instance
     std::string toString() const;
 
@@ -155,7 +226,21 @@ public:
      * */
     EClassType getClassType() const { return EMesh; }
 
-    const EmitterQueryRecord sample(Sampler* sampler) const;
+    /// Sample a position uniformly on the surface (the pdf is expressed per unit area)
+    virtual const EmitterQueryRecord sample(Sampler* sampler) const;
+
+    /**
+     * \brief Sample a position on the surface as seen from the point \c ref
+     *
+     * Shapes that can do so sample the solid angle subtended by the
+     * shape instead of its area. The returned pdf is always expressed
+     * per unit area, so that callers can treat all shapes alike. The
+     * default implementation samples the area uniformly.
+     */
+    virtual const EmitterQueryRecord sample(const Point3f &ref, Sampler* sampler) const;
+
+    /// Return the area density of \ref sample(ref, sampler) for the position stored in \c eRec
+    virtual float pdf(const Point3f &ref, const EmitterQueryRecord &eRec) const;
 protected:
     /// Create an empty mesh
     Mesh();
@@ -164,13 +249,16 @@ protected:
     std::string m_name;                  ///< Identifying name
     MatrixXf      m_V;                   ///< Vertex positions
     MatrixXf      m_N;                   ///< Vertex normals
+    MatrixXf      m_V1;                  ///< Vertex positions at the end of the shutter (optional)
+    MatrixXf      m_N1;                  ///< Vertex normals at the end of the shutter (optional)
     MatrixXf      m_UV;                  ///< Vertex texture coordinates
     MatrixXu      m_F;                   ///< Faces
     BSDF         *m_bsdf = nullptr;      ///< BSDF of the surface
     Emitter    *m_emitter = nullptr;     ///< Associated emitter, if any
-    BoundingBox3f m_bbox;                ///< Bounding box of the mesh
+    BoundingBox3f m_bbox;                ///< Bounding box of the mesh (over the shutter interval)
+    uint32_t      m_objectID = 0;        ///< Index of the mesh within the scene
 public:
-    DiscretePDF dpdf;         ///< PDF of light distribution between triagles
+    DiscretePDF dpdf;         ///< PDF of light distribution between triangles
 };
 
 
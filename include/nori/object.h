@@ -31,6 +31,7 @@ public:
         ETest,
         EReconstructionFilter,
         ETexture,
+        EDenoiser,
 
         /*<-------------------------->*/
         EClassTypeCount //This must always be the last
@@ -90,6 +91,7 @@ public:
             case ESampler:    return "sampler";
             case ETest:       return "test";
             case ETexture:    return "texture";
+            case EDenoiser:   return "denoiser";
             default:          return "<unknown>";
         }
     }
@@ -16,4 +16,12 @@ NORI_NAMESPACE_BEGIN
  */
 extern NoriObject *loadFromXML(const std::string &filename);
 
+/**
+ * \brief Load a scene (or a single object, such as a camera)
+ * from an XML document in memory and return its root object
+ *
+ * Relative paths are resolved using the global file resolver.
+ */
+extern NoriObject *loadFromXMLString(const std::string &xml);
+
 NORI_NAMESPACE_END
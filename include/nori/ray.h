@@ -17,6 +17,8 @@ NORI_NAMESPACE_BEGIN
  * stores a ray segment [mint, maxt] (whose entries may include positive/negative
  * infinity), as well as the componentwise reciprocals of the ray direction.
  * That is just done for convenience, as these values are frequently required.
+ * Each ray also carries a time value in the normalized shutter interval [0, 1],
+ * which is used to intersect moving geometry (motion blur).
  *
  * \remark Important: be careful when changing the ray direction. You must
  * call \ref update() to compute the componentwise reciprocals as well, or Nori's
@@ -32,31 +34,38 @@ template <typename _PointType, typename _VectorType> struct TRay {
     VectorType dRcp; ///< Componentwise reciprocals of the ray direction
     Scalar mint;     ///< Minimum position on the ray segment
     Scalar maxt;     ///< Maximum position on the ray segment
+    Scalar time;     ///< Time value in the normalized shutter interval
 
     /// Construct a new ray
     TRay() : mint(Epsilon), 
-        maxt(std::numeric_limits<Scalar>::infinity()) { }
+        maxt(std::numeric_limits<Scalar>::infinity()), time(0) { }
     
     /// Construct a new ray
     TRay(const PointType &o, const VectorType &d) : o(o), d(d), 
-            mint(Epsilon), maxt(std::numeric_limits<Scalar>::infinity()) {
+            mint(Epsilon), maxt(std::numeric_limits<Scalar>::infinity()), time(0) {
         update();
     }
 
     /// Construct a new ray
     TRay(const PointType &o, const VectorType &d, 
-        Scalar mint, Scalar maxt) : o(o), d(d), mint(mint), maxt(maxt) {
+        Scalar mint, Scalar maxt) : o(o), d(d), mint(mint), maxt(maxt), time(0) {
+        update();
+    }
+
+    /// Construct a new ray at the given time
+    TRay(const PointType &o, const VectorType &d,
+        Scalar mint, Scalar maxt, Scalar time) : o(o), d(d), mint(mint), maxt(maxt), time(time) {
         update();
     }
 
     /// Copy constructor
     TRay(const TRay &ray) 
      : o(ray.o), d(ray.d), dRcp(ray.dRcp),
-       mint(ray.mint), maxt(ray.maxt) { }
+       mint(ray.mint), maxt(ray.maxt), time(ray.time) { }
 
     /// Copy a ray, but change the covered segment of the copy
     TRay(const TRay &ray, Scalar mint, Scalar maxt) 
-     : o(ray.o), d(ray.d), dRcp(ray.dRcp), mint(mint), maxt(maxt) { }
+     : o(ray.o), d(ray.d), dRcp(ray.dRcp), mint(mint), maxt(maxt), time(ray.time) { }
 
     /// Update the reciprocal ray directions after changing 'd'
     void update() {
@@ -71,6 +80,7 @@ template <typename _PointType, typename _VectorType> struct TRay {
         TRay result;
         result.o = o; result.d = -d; result.dRcp = -dRcp;
         result.mint = mint; result.maxt = maxt;
+        result.time = time;
         return result;
     }
 
@@ -81,8 +91,9 @@ template <typename _PointType, typename _VectorType> struct TRay {
                 "  o = %s,\n"
                 "  d = %s,\n"
                 "  mint = %f,\n"
-                "  maxt = %f\n"
-                "]", o.toString(), d.toString(), mint, maxt);
+                "  maxt = %f,\n"
+                "  time = %f\n"
+                "]", o.toString(), d.toString(), mint, maxt, time);
     }
 };
 
@@ -24,6 +24,12 @@ NORI_NAMESPACE_BEGIN
  * which is freely available at:
  *
  * http://graphics.stanford.edu/~mmp/chapters/pbrt_chapter7.pdf
+ *
+ * All filters accept the boolean parameter \c importanceSample. When set,
+ * samples are not splatted into all pixels within the filter radius.
+ * Instead, the offset of every sample from its pixel center is drawn
+ * proportionally to the filter, and the sample only contributes to that
+ * pixel (filter importance sampling, see \ref ImageBlock::sampleFilter()).
  */
 class ReconstructionFilter : public NoriObject {
 public:
@@ -33,13 +39,23 @@ public:
     /// Evaluate the filter function
     virtual float eval(float x) const = 0;
 
+    /// Should sample positions be drawn from the filter instead of splatting samples?
+    bool isImportanceSampled() const { return m_importanceSample; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Camera/etc.) 
      * provided by this instance
      * */
     EClassType getClassType() const { return EReconstructionFilter; }
+protected:
+    /// Initialize the parameters shared by all filters
+    ReconstructionFilter(const PropertyList &propList) {
+        m_importanceSample = propList.getBoolean("importanceSample", false);
+    }
+
 protected:
     float m_radius;
+    bool m_importanceSample;
 };
 
 NORI_NAMESPACE_END
@@ -32,7 +32,8 @@ class ImageBlock;
  *
  * The general interface between a sampler and a rendering algorithm is as 
  * follows: Before beginning to render a pixel, the rendering algorithm calls 
- * \ref generate(). The first pixel sample can now be computed, after which
+ * \ref generate() with the pixel coordinates. The first pixel sample (whose
+ * index is the sample offset, see \ref setSampleOffset()) can now be computed, after which
  * \ref advance() needs to be invoked. This repeats until all pixel samples have
  * been exhausted.  While computing a pixel sample, the rendering 
  * algorithm requests (pseudo-) random numbers using the \ref next1D() and
@@ -69,11 +70,13 @@ public:
      * \brief Prepare to generate new samples
      * 
      * This function is called initially and every time the 
-     * integrator starts rendering a new pixel.
+     * integrator starts rendering a new pixel. The samples
+     * are a deterministic function of the pixel and the sample
+     * index, which starts at the sample offset.
      */
-    virtual void generate() = 0;
+    virtual void generate(const Point2i &pixel) = 0;
 
-    /// Advance to the next sample
+    /// Advance to the next sample (and restart at the first component)
     virtual void advance() = 0;
 
     /// Retrieve the next component value from the current sample
@@ -85,6 +88,19 @@ public:
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
+    /**
+     * \brief Set the index of the first pixel sample of the next blocks
+     *
+     * When an image is rendered progressively in several passes, this
+     * is set to the number of samples that earlier passes have already
+     * taken, so that every pass produces a different set of samples.
+     * It must be set before calling \ref prepare().
+     */
+    void setSampleOffset(size_t offset) { m_sampleOffset = offset; }
+
+    /// Return the index of the first pixel sample (see \ref setSampleOffset())
+    size_t getSampleOffset() const { return m_sampleOffset; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Sampler/etc.) 
      * provided by this instance
@@ -92,6 +108,7 @@ public:
     EClassType getClassType() const { return ESampler; }
 protected:
     size_t m_sampleCount;
+    size_t m_sampleOffset = 0;
 };
 
 NORI_NAMESPACE_END
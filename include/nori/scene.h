@@ -8,6 +8,7 @@
 
 #include <nori/accel.h>
 #include <nori/dpdf.h>
+#include <nori/stats.h>
 NORI_NAMESPACE_BEGIN
 
 /**
@@ -37,6 +38,12 @@ public:
     /// Return a pointer to the scene's camera
     const Camera *getCamera() const { return m_camera; }
 
+    /// Return a pointer to the scene's camera
+    Camera *getCamera() { return m_camera; }
+
+    /// Return a pointer to the scene's denoiser (or \c nullptr if there is none)
+    const Denoiser *getDenoiser() const { return m_denoiser; }
+
     /// Return a pointer to the scene's sample generator (const version)
     const Sampler *getSampler() const { return m_sampler; }
 
@@ -61,6 +68,7 @@ public:
      * \return \c true if an intersection was found
      */
     bool rayIntersect(const Ray3f &ray, Intersection &its) const {
+        Statistics::add(Statistics::EClosestHitRays);
         return m_accel->rayIntersect(ray, its, false);
     }
 
@@ -81,6 +89,7 @@ public:
      */
     bool rayIntersect(const Ray3f &ray) const {
         Intersection its; /* Unused */
+        Statistics::add(Statistics::EShadowRays);
         return m_accel->rayIntersect(ray, its, true);
     }
 
@@ -89,6 +98,9 @@ public:
         return m_accel->getBoundingBox();
     }
 
+    /// Does the scene contain moving geometry? (rays then need time samples)
+    bool hasMotion() const { return m_accel->hasMotion(); }
+
     /**
      * \brief Inherited from \ref NoriObject::activate()
      *
@@ -100,6 +112,14 @@ public:
     /// Add a child object to the scene (meshes, integrators etc.)
     void addChild(NoriObject *obj);
 
+    /**
+     * \brief Replace the scene's camera, integrator, sampler or denoiser
+     *
+     * The previous object is released. This allows rendering the same
+     * (already loaded) geometry with different settings.
+     */
+    void replaceChild(NoriObject *obj);
+
     /// Return a string summary of the scene (for debugging purposes)
     std::string toString() const;
 
@@ -115,6 +135,7 @@ private:
     Integrator *m_integrator = nullptr;
     Sampler *m_sampler = nullptr;
     Camera *m_camera = nullptr;
+    Denoiser *m_denoiser = nullptr;
     Accel *m_accel = nullptr;
 
     DiscretePDF lightsPDF;
@@ -0,0 +1,132 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/vector.h>
+#include <tbb/mutex.h>
+#include <atomic>
+#include <map>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Low-overhead counters describing the throughput and progress of a render
+ *
+ * Every thread increments its own set of counters, which is padded to a
+ * cache line, so the render threads never write to shared memory. Readers
+ * such as the preview window take a \ref Snapshot from time to time and
+ * compute rates from the difference between two of them. The counters
+ * are read without synchronization and may thus be slightly stale.
+ */
+class Statistics {
+public:
+    /// Per-thread counters
+    enum ECounter {
+        ESamples = 0,      ///< Camera samples
+        EClosestHitRays,   ///< Rays that search for the closest intersection
+        EShadowRays,       ///< Rays that only test for occlusion
+        EBusyTime,         ///< Nanoseconds spent rendering blocks
+        ECounterCount
+    };
+
+    /// State of all counters at one point in time
+    struct Snapshot {
+        double time;                   ///< Milliseconds since \ref beginRender()
+        uint64_t totals[ECounterCount];
+        std::vector<uint64_t> busyTime; ///< \ref EBusyTime of each thread
+        uint64_t workDone;
+        uint64_t workTotal;
+    };
+
+    /// Return a counter of the calling thread
+    static uint64_t get(ECounter counter) {
+        return local().values[counter].load(std::memory_order_relaxed);
+    }
+
+    /// Add to a counter of the calling thread
+    static void add(ECounter counter, uint64_t amount = 1) {
+        /* Only this thread writes the value, so no atomic read-modify-write is needed */
+        std::atomic<uint64_t> &value = local().values[counter];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Start tracking the progress of a render
+     *
+     * \param workTotal
+     *    Amount of work (e.g. pixel samples) that the render will perform
+     */
+    static void beginRender(uint64_t workTotal);
+
+    /// Record that some of the work announced in \ref beginRender() was done
+    static void addWork(uint64_t amount) { s_workDone.fetch_add(amount, std::memory_order_relaxed); }
+
+    /// Sum up the counters of all threads
+    static Snapshot snapshot();
+
+    /// Counters of one thread, padded to avoid false sharing
+    struct alignas(64) ThreadCounters {
+        std::atomic<uint64_t> values[ECounterCount];
+    };
+
+private:
+
+    /// Return the counters of the calling thread
+    static ThreadCounters &local() {
+        if (!s_local)
+            s_local = registerThread();
+        return *s_local;
+    }
+
+    /// Allocate counters for the calling thread
+    static ThreadCounters *registerThread();
+
+    static thread_local ThreadCounters *s_local;
+    static std::atomic<uint64_t> s_workDone, s_workTotal;
+};
+
+/**
+ * \brief Cost of each block of the image, accumulated over all passes
+ *
+ * This shows which regions of the image are expensive to render, e.g.
+ * due to pathological geometry or materials.
+ */
+class TileStatistics {
+public:
+    /// Statistics of one block
+    struct Tile {
+        Vector2i size = Vector2i(0);
+        double time = 0;              ///< Milliseconds spent in \c renderBlock()
+        uint64_t samples = 0;
+        uint64_t closestHitRays = 0;
+        uint64_t shadowRays = 0;
+    };
+
+    /// Add the cost of rendering a block (thread-safe)
+    void put(const Point2i &offset, const Vector2i &size, double time,
+             uint64_t samples, uint64_t closestHitRays, uint64_t shadowRays);
+
+    /**
+     * \brief Return a heatmap of an image with the given size
+     *
+     * The RGB channels contain the render time per pixel in microseconds,
+     * the additional channels \c samples, \c closestHitRays and
+     * \c shadowRays the respective counts per pixel. Pixels outside of
+     * the rendered blocks are zero.
+     */
+    Bitmap *toBitmap(const Vector2i &size) const;
+
+    /// Write one line per block (offset, size, time and counts) to a CSV file
+    void saveCSV(const std::string &filename) const;
+
+protected:
+    /// Blocks indexed by their offset (y first, i.e. in scanline order)
+    std::map<std::pair<int, int>, Tile> m_tiles;
+    mutable tbb::mutex m_mutex;
+};
+
+NORI_NAMESPACE_END
@@ -0,0 +1,116 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/block.h>
+#include <nori/bitmap.h>
+#include <map>
+
+namespace Imf { class TiledOutputFile; }
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Frame buffer that streams finished tiles into a tiled OpenEXR file
+ *
+ * Instead of accumulating the entire image in memory, this class only
+ * stores the tiles that can still receive contributions. The tiles
+ * coincide with the blocks of a \ref BlockGenerator (which must not split
+ * its tail blocks). Because of the reconstruction filter, a rendered block
+ * also contributes to the borders of its neighbors, hence a tile is
+ * complete once all blocks within the filter's reach have been merged.
+ * It is then normalized, written to the file and released.
+ *
+ * The number of tiles held in memory thus depends on the block order
+ * (and the number of threads), but not on the resolution of the image.
+ * With scanline order, it is bounded by about two rows of tiles.
+ */
+class StreamingFramebuffer {
+public:
+    /**
+     * \brief Create the output file and prepare for receiving blocks
+     *
+     * \param filename
+     *     Name of the OpenEXR file (including the extension)
+     * \param imageSize
+     *     Size of the full image (the display window of the file)
+     * \param offset, size
+     *     Region that is rendered (the data window of the file)
+     * \param tileSize
+     *     Block size of the \ref BlockGenerator that produces the blocks
+     * \param filter
+     *     Reconstruction filter that the blocks were rendered with
+     * \param aovs
+     *     Output variables that are written as additional channels
+     * \param compression
+     *     Compression method of the tiles
+     * \param halfChannels
+     *     Names of the channels that are stored with 16 bit precision
+     */
+    StreamingFramebuffer(const std::string &filename, const Vector2i &imageSize,
+                         const Point2i &offset, const Vector2i &size, int tileSize,
+                         const ReconstructionFilter *filter, const AOVList &aovs,
+                         Bitmap::ECompression compression = Bitmap::EZIP,
+                         const std::vector<std::string> &halfChannels = std::vector<std::string>());
+
+    /// Write any remaining tiles and close the file
+    ~StreamingFramebuffer();
+
+    /**
+     * \brief Merge a rendered block and write the tiles it completes
+     *
+     * This function is designed to be called concurrently by many threads.
+     */
+    void put(const ImageBlock &block);
+
+    /**
+     * \brief Write all tiles that haven't been written yet
+     *
+     * This is needed when not all blocks were rendered (e.g. due to a time
+     * limit); the missing contributions are then treated as zero.
+     */
+    void finish();
+
+    /// Return the maximum number of tiles that were held in memory at once
+    size_t getPeakTileCount() const { return m_peakTiles; }
+
+    /// Return the amount of memory used by one tile in bytes
+    size_t getTileMemory() const;
+
+protected:
+    struct Tile {
+        Tile(const Vector2i &size, const ReconstructionFilter *filter, const AOVList &aovs)
+            : block(size, filter, aovs) { }
+        ImageBlock block;
+        tbb::spin_mutex mutex;
+    };
+
+    /// Return the tile with the given index, creating it if necessary (locks \c m_mutex)
+    Tile *acquire(int index);
+
+    /// Normalize a complete tile and write it to the file
+    void write(int index, const ImageBlock &block);
+
+    Point2i m_offset;
+    Vector2i m_size;
+    int m_tileSize;
+    Vector2i m_numTiles;
+    int m_reach;                         ///< Number of neighboring tiles a block contributes to (per direction)
+    const ReconstructionFilter *m_filter;
+    AOVList m_aovs;
+
+    tbb::mutex m_mutex;                  ///< Protects the tile map and the counters
+    std::map<int, std::unique_ptr<Tile>> m_tiles;
+    std::vector<int> m_pending;          ///< Number of blocks that still contribute to each tile
+    std::vector<uint8_t> m_written;      ///< Has the tile been written to the file?
+    size_t m_peakTiles = 0;
+
+    tbb::mutex m_fileMutex;              ///< Serializes writes to the file
+    std::unique_ptr<Imf::TiledOutputFile> m_file;
+};
+
+NORI_NAMESPACE_END
@@ -72,7 +72,7 @@ public:
         return Ray3f(
             operator*(r.o), 
             operator*(r.d), 
-            r.mint, r.maxt
+            r.mint, r.maxt, r.time
         );
     }
 
@@ -289,7 +289,7 @@ public:
 
 void Accel::addMesh(Mesh *mesh) {
     m_meshes.push_back(mesh);
-    m_meshOffset.push_back(m_meshOffset.back() + mesh->getTriangleCount());
+    m_meshOffset.push_back(m_meshOffset.back() + mesh->getPrimitiveCount());
     m_bbox.expandBy(mesh->getBoundingBox());
 }
 
@@ -301,20 +301,22 @@ void Accel::clear() {
     m_meshOffset.push_back(0u);
     m_nodes.clear();
     m_indices.clear();
+    m_motionBounds.clear();
     m_bbox.reset();
     m_nodes.shrink_to_fit();
     m_meshes.shrink_to_fit();
     m_meshOffset.shrink_to_fit();
     m_indices.shrink_to_fit();
+    m_motionBounds.shrink_to_fit();
 }
 
 void Accel::build() {
-    uint32_t size  = getTriangleCount();
+    uint32_t size  = getPrimitiveCount();
     if (size == 0)
         return;
     cout << "Constructing a SAH BVH (" << m_meshes.size()
     << (m_meshes.size() == 1 ? " mesh, " : " meshes, ")
-    << size << " triangles) .. ";
+    << size << " primitives) .. ";
     cout.flush();
     Timer timer;
     
@@ -361,6 +363,40 @@ void Accel::build() {
     << ")." << endl;
     
     m_nodes = std::move(compactified);
+
+    bool motion = false;
+    for (auto mesh : m_meshes)
+        motion |= mesh->hasMotion();
+
+    if (motion) {
+        /* Store a pair of start/end-of-shutter bounding boxes per node */
+        m_motionBounds.resize(2 * m_nodes.size());
+        refitMotionBounds();
+    }
+}
+
+void Accel::refitMotionBounds(uint32_t node_idx) {
+    const BVHNode &node = m_nodes[node_idx];
+    BoundingBox3f &bbox0 = m_motionBounds[2 * node_idx],
+                  &bbox1 = m_motionBounds[2 * node_idx + 1];
+
+    if (node.isLeaf()) {
+        bbox0.reset();
+        bbox1.reset();
+        for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
+            bbox0.expandBy(getBoundingBox(m_indices[i], 0.0f));
+            bbox1.expandBy(getBoundingBox(m_indices[i], 1.0f));
+        }
+    } else {
+        uint32_t left = node_idx + 1u, right = node.inner.rightChild;
+        refitMotionBounds(left);
+        refitMotionBounds(right);
+
+        /* Linear motion: interpolating the child bounds never
+           leaves the interpolation of the merged bounds */
+        bbox0 = BoundingBox3f::merge(m_motionBounds[2 * left], m_motionBounds[2 * right]);
+        bbox1 = BoundingBox3f::merge(m_motionBounds[2 * left + 1], m_motionBounds[2 * right + 1]);
+    }
 }
 
 std::pair<float, uint32_t> Accel::statistics(uint32_t node_idx) const {
@@ -396,13 +432,26 @@ bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) c
     if (m_nodes.empty() || ray.maxt < ray.mint)
         return false;
     
-    bool foundIntersection = false;
+    bool foundIntersection = false, motion = hasMotion();
     uint32_t f = 0;
     
     while (true) {
         const BVHNode &node = m_nodes[node_idx];
+        bool hit;
+
+        if (motion) {
+            /* Interpolate the node bounds at the time of the ray */
+            const BoundingBox3f &bbox0 = m_motionBounds[2 * node_idx],
+                                &bbox1 = m_motionBounds[2 * node_idx + 1];
+            BoundingBox3f bbox(
+                (1.0f - ray.time) * bbox0.min + ray.time * bbox1.min,
+                (1.0f - ray.time) * bbox0.max + ray.time * bbox1.max);
+            hit = bbox.rayIntersect(ray);
+        } else {
+            hit = node.bbox.rayIntersect(ray);
+        }
         
-        if (!node.bbox.rayIntersect(ray)) {
+        if (!hit) {
             if (stack_idx == 0)
                 break;
             node_idx = stack[--stack_idx];
@@ -437,49 +486,8 @@ bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) c
     }
     
     if (foundIntersection) {
-        /* Find the barycentric coordinates */
-        Vector3f bary;
-        bary << 1-its.uv.sum(), its.uv;
-        
-        /* References to all relevant mesh buffers */
-        const Mesh *mesh   = its.mesh;
-        const MatrixXf &V  = mesh->getVertexPositions();
-        const MatrixXf &N  = mesh->getVertexNormals();
-        const MatrixXf &UV = mesh->getVertexTexCoords();
-        const MatrixXu &F  = mesh->getIndices();
-        
-        /* Vertex indices of the triangle */
-        uint32_t idx0 = F(0, f), idx1 = F(1, f), idx2 = F(2, f);
-        
-        Point3f p0 = V.col(idx0), p1 = V.col(idx1), p2 = V.col(idx2);
-        
-        /* Compute the intersection positon accurately
-         using barycentric coordinates */
-        its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
-        
-        /* Compute proper texture coordinates if provided by the mesh */
-        if (UV.size() > 0)
-            its.uv = bary.x() * UV.col(idx0) +
-            bary.y() * UV.col(idx1) +
-            bary.z() * UV.col(idx2);
-        
-        /* Compute the geometry frame */
-        its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
-        
-        if (N.size() > 0) {
-            /* Compute the shading frame. Note that for simplicity,
-             the current implementation doesn't attempt to provide
-             tangents that are continuous across the surface. That
-             means that this code will need to be modified to be able
-             use anisotropic BRDFs, which need tangent continuity */
-            
-            its.shFrame = Frame(
-                                (bary.x() * N.col(idx0) +
-                                 bary.y() * N.col(idx1) +
-                                 bary.z() * N.col(idx2)).normalized());
-        } else {
-            its.shFrame = its.geoFrame;
-        }
+        /* Let the shape compute the remaining hit information */
+        its.mesh->setHitInformation(f, ray, its);
     }
     
     return foundIntersection;
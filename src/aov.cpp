@@ -0,0 +1,99 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/aov.h>
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+
+NORI_NAMESPACE_BEGIN
+
+void AOVRecord::setSurface(const Intersection &its) {
+    const BSDF *bsdf = its.mesh->getBSDF();
+    albedo = bsdf ? bsdf->getAlbedo(its) : Color3f(0.0f);
+    normal = its.shFrame.n;
+    depth = its.t;
+    position = its.p;
+    objectID = (float) (its.mesh->getObjectID() + 1);
+    alpha = 1.0f;
+}
+
+AOVList::AOVList(const std::string &names) {
+    for (const std::string &token : tokenize(names, ", ")) {
+        std::string name = toLower(token);
+        if (name == "albedo") {
+            m_types.push_back(EAlbedo);
+            m_channelNames.insert(m_channelNames.end(), { "albedo.R", "albedo.G", "albedo.B" });
+        } else if (name == "normal") {
+            m_types.push_back(ENormal);
+            m_channelNames.insert(m_channelNames.end(), { "normal.X", "normal.Y", "normal.Z" });
+        } else if (name == "depth") {
+            m_types.push_back(EDepth);
+            m_channelNames.push_back("depth.Z");
+        } else if (name == "position") {
+            m_types.push_back(EPosition);
+            m_channelNames.insert(m_channelNames.end(), { "position.X", "position.Y", "position.Z" });
+        } else if (name == "id") {
+            m_types.push_back(EObjectID);
+            m_channelNames.push_back("id.ID");
+        } else if (name == "alpha") {
+            m_types.push_back(EAlpha);
+            m_channelNames.push_back("A");
+        } else {
+            throw NoriException("Unknown output variable \"%s\" (expected albedo, "
+                                "normal, depth, position, id or alpha)", token);
+        }
+    }
+}
+
+int AOVList::getChannelIndex(EType type) const {
+    int index = 0;
+    for (EType t : m_types) {
+        if (t == type)
+            return index;
+        index += (t == EDepth || t == EObjectID || t == EAlpha) ? 1 : 3;
+    }
+    return -1;
+}
+
+void AOVList::write(const AOVRecord &rec, float *target) const {
+    for (EType type : m_types) {
+        switch (type) {
+            case EAlbedo:
+                for (int i = 0; i < 3; ++i)
+                    *target++ = rec.albedo[i];
+                break;
+            case ENormal:
+                for (int i = 0; i < 3; ++i)
+                    *target++ = rec.normal[i];
+                break;
+            case EDepth:
+                *target++ = rec.depth;
+                break;
+            case EPosition:
+                for (int i = 0; i < 3; ++i)
+                    *target++ = rec.position[i];
+                break;
+            case EObjectID:
+                *target++ = rec.firstSample ? rec.objectID : 0.0f;
+                break;
+            case EAlpha:
+                *target++ = rec.alpha;
+                break;
+        }
+    }
+}
+
+std::string AOVList::toString() const {
+    std::string result;
+    for (size_t i = 0; i < m_channelNames.size(); ++i) {
+        result += m_channelNames[i];
+        if (i + 1 < m_channelNames.size())
+            result += ", ";
+    }
+    return tfm::format("AOVList[%s]", result);
+}
+
+NORI_NAMESPACE_END
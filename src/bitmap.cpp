@@ -11,6 +11,9 @@
 #include <ImfStringAttribute.h>
 #include <ImfVersion.h>
 #include <ImfIO.h>
+#include <ImfThreading.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
@@ -18,7 +21,8 @@
 NORI_NAMESPACE_BEGIN
 
 Bitmap::Bitmap(const std::string &filename) {
-    Imf::InputFile file(filename.c_str());
+    /* Scanlines are decompressed (and converted to float) by OpenEXR's global thread pool */
+    Imf::InputFile file(filename.c_str(), Imf::globalThreadCount());
     const Imf::Header &header = file.header();
     const Imf::ChannelList &channels = header.channels();
 
@@ -52,21 +56,40 @@ Bitmap::Bitmap(const std::string &filename) {
     if (!ch_r || !ch_g || !ch_b)
         throw NoriException("This is not a standard RGB OpenEXR file!");
 
+    /* Keep the precision when the bitmap is saved again */
+    m_half = channels.findChannel(ch_r)->type == Imf::HALF;
+
+    /* OpenEXR addresses the frame buffer using the coordinates of the data window */
     size_t compStride = sizeof(float),
            pixelStride = 3 * compStride,
            rowStride = pixelStride * cols();
+    ptrdiff_t origin = dw.min.x + dw.min.y * (ptrdiff_t) cols();
 
-    char *ptr = reinterpret_cast<char *>(data());
+    char *ptr = reinterpret_cast<char *>(data()) - origin * pixelStride;
 
     Imf::FrameBuffer frameBuffer;
     frameBuffer.insert(ch_r, Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
     frameBuffer.insert(ch_g, Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
     frameBuffer.insert(ch_b, Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+
+    /* Load all other channels (e.g. output variables) as additional layers */
+    for (Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it) {
+        std::string name = it.name();
+        if (it.channel().xSampling != 1 || it.channel().ySampling != 1 ||
+            name == ch_r || name == ch_g || name == ch_b)
+            continue;
+        addChannel(it.name()).half = it.channel().type == Imf::HALF;
+    }
+    for (Channel &channel : m_channels)
+        frameBuffer.insert(channel.name, Imf::Slice(Imf::FLOAT,
+            reinterpret_cast<char *>(channel.data.data()) - origin * compStride,
+            compStride, compStride * cols()));
+
     file.setFrameBuffer(frameBuffer);
     file.readPixels(dw.min.y, dw.max.y);
 }
 
-void Bitmap::saveEXR(const std::string &filename) {
+void Bitmap::saveEXR(const std::string &filename, ECompression compression) {
     cout << "Writing a " << cols() << "x" << rows()
          << " OpenEXR file to \"" << filename << "\"" << endl;
 
@@ -74,11 +97,19 @@ void Bitmap::saveEXR(const std::string &filename) {
 
     Imf::Header header((int) cols(), (int) rows());
     header.insert("comments", Imf::StringAttribute("Generated by Nori"));
+    switch (compression) {
+        case ENoCompression: header.compression() = Imf::NO_COMPRESSION; break;
+        case EZIP: header.compression() = Imf::ZIP_COMPRESSION; break;
+        case EPIZ: header.compression() = Imf::PIZ_COMPRESSION; break;
+        case EDWAA: header.compression() = Imf::DWAA_COMPRESSION; break;
+    }
 
     Imf::ChannelList &channels = header.channels();
-    channels.insert("R", Imf::Channel(Imf::FLOAT));
-    channels.insert("G", Imf::Channel(Imf::FLOAT));
-    channels.insert("B", Imf::Channel(Imf::FLOAT));
+    /* OpenEXR converts the (float) frame buffer to the pixel type of the file */
+    Imf::PixelType type = m_half ? Imf::HALF : Imf::FLOAT;
+    channels.insert("R", Imf::Channel(type));
+    channels.insert("G", Imf::Channel(type));
+    channels.insert("B", Imf::Channel(type));
 
     Imf::FrameBuffer frameBuffer;
     size_t compStride = sizeof(float),
@@ -90,11 +121,106 @@ void Bitmap::saveEXR(const std::string &filename) {
     frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
     frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
 
+    /* Additional layers (e.g. output variables) */
+    for (Channel &channel : m_channels) {
+        channels.insert(channel.name, Imf::Channel(channel.half ? Imf::HALF : Imf::FLOAT));
+        frameBuffer.insert(channel.name, Imf::Slice(Imf::FLOAT,
+            reinterpret_cast<char *>(channel.data.data()), compStride, compStride * cols()));
+    }
+
     Imf::OutputFile file(path.c_str(), header);
     file.setFrameBuffer(frameBuffer);
     file.writePixels((int) rows());
 }
 
+Bitmap::Channel &Bitmap::addChannel(const std::string &name) {
+    for (const Channel &channel : m_channels)
+        if (channel.name == name)
+            throw NoriException("Bitmap::addChannel(): channel \"%s\" already exists!", name);
+
+    m_channels.push_back(Channel());
+    m_channels.back().name = name;
+    m_channels.back().data.resize(rows(), cols());
+    return m_channels.back();
+}
+
+void Bitmap::composite(const Bitmap &base, const Point2i &offset, const Vector2i &size) {
+    if (base.cols() != cols() || base.rows() != rows())
+        throw NoriException("Bitmap::composite(): the image sizes don't match (%ix%i vs %ix%i)!",
+            base.cols(), base.rows(), cols(), rows());
+
+    auto outside = [&](int x, int y) {
+        return x < offset.x() || y < offset.y() ||
+               x >= offset.x() + size.x() || y >= offset.y() + size.y();
+    };
+
+    for (int y = 0; y < rows(); ++y)
+        for (int x = 0; x < cols(); ++x)
+            if (outside(x, y))
+                coeffRef(y, x) = base.coeff(y, x);
+
+    /* Channels that are missing in the base image remain zero outside the region */
+    for (Channel &channel : m_channels) {
+        const Channel *baseChannel = nullptr;
+        for (const Channel &c : base.m_channels)
+            if (c.name == channel.name)
+                baseChannel = &c;
+
+        for (int y = 0; y < rows(); ++y)
+            for (int x = 0; x < cols(); ++x)
+                if (outside(x, y))
+                    channel.data(y, x) = baseChannel ? baseChannel->data(y, x) : 0.0f;
+    }
+}
+
+bool Bitmap::accumulate(const Bitmap &partial) {
+    if (partial.cols() != cols() || partial.rows() != rows() ||
+        partial.m_channels.size() != m_channels.size())
+        return false;
+    for (size_t c = 0; c < m_channels.size(); ++c)
+        if (partial.m_channels[c].name != m_channels[c].name)
+            return false;
+
+    *this += partial;
+    for (size_t c = 0; c < m_channels.size(); ++c)
+        m_channels[c].data += partial.m_channels[c].data;
+    return true;
+}
+
+Bitmap *Bitmap::normalize() const {
+    const Channel *weight = nullptr;
+    for (const Channel &channel : m_channels)
+        if (channel.name == "filterWeight")
+            weight = &channel;
+    if (!weight)
+        throw NoriException("Bitmap::normalize(): the bitmap has no filter weights!");
+
+    Bitmap *result = new Bitmap(Vector2i((int) cols(), (int) rows()));
+    for (const Channel &channel : m_channels)
+        if (&channel != weight)
+            result->addChannel(channel.name);
+
+    std::vector<bool> unfiltered;
+    for (const Channel &channel : m_channels) {
+        const std::string &name = channel.name;
+        unfiltered.push_back(name.size() >= 3 && name.compare(name.size() - 3, 3, ".ID") == 0);
+    }
+
+    for (int y = 0; y < rows(); ++y) {
+        for (int x = 0; x < cols(); ++x) {
+            float w = weight->data(y, x);
+            result->coeffRef(y, x) = w != 0 ? Color3f(coeff(y, x) / w) : Color3f(0.0f);
+            for (size_t c = 0, k = 0; c < m_channels.size(); ++c) {
+                if (&m_channels[c] == weight)
+                    continue;
+                float value = m_channels[c].data(y, x);
+                result->m_channels[k++].data(y, x) = unfiltered[c] ? value : (w != 0 ? value / w : 0.0f);
+            }
+        }
+    }
+    return result;
+}
+
 void Bitmap::savePNG(const std::string &filename) {
     cout << "Writing a " << cols() << "x" << rows()
          << " PNG file to \"" << filename << "\"" << endl;
@@ -102,16 +228,18 @@ void Bitmap::savePNG(const std::string &filename) {
     std::string path = filename + ".png";
 
     uint8_t *rgb8 = new uint8_t[3 * cols() * rows()];
-    uint8_t *dst = rgb8;
-    for (int i = 0; i < rows(); ++i) {
-        for (int j = 0; j < cols(); ++j) {
-            Color3f tonemapped = coeffRef(i, j).toSRGB();
-            dst[0] = (uint8_t) clamp(255.f * tonemapped[0], 0.f, 255.f);
-            dst[1] = (uint8_t) clamp(255.f * tonemapped[1], 0.f, 255.f);
-            dst[2] = (uint8_t) clamp(255.f * tonemapped[2], 0.f, 255.f);
-            dst += 3;
+    tbb::parallel_for(tbb::blocked_range<int>(0, (int) rows()), [&](const tbb::blocked_range<int> &range) {
+        for (int i = range.begin(); i < range.end(); ++i) {
+            uint8_t *dst = rgb8 + 3 * cols() * i;
+            for (int j = 0; j < cols(); ++j) {
+                Color3f tonemapped = coeffRef(i, j).toSRGB();
+                dst[0] = (uint8_t) clamp(255.f * tonemapped[0], 0.f, 255.f);
+                dst[1] = (uint8_t) clamp(255.f * tonemapped[1], 0.f, 255.f);
+                dst[2] = (uint8_t) clamp(255.f * tonemapped[2], 0.f, 255.f);
+                dst += 3;
+            }
         }
-    }
+    });
 
     int ret = stbi_write_png(path.c_str(), (int) cols(), (int) rows(), 3, rgb8, 3 * (int) cols());
     if (ret == 0) {
@@ -121,4 +249,17 @@ void Bitmap::savePNG(const std::string &filename) {
     delete[] rgb8;
 }
 
+Bitmap::ECompression Bitmap::parseCompression(const std::string &name) {
+    std::string value = toLower(name);
+    if (value == "none")
+        return ENoCompression;
+    else if (value == "zip")
+        return EZIP;
+    else if (value == "piz")
+        return EPIZ;
+    else if (value == "dwaa")
+        return EDWAA;
+    throw NoriException("Unknown compression \"%s\" (expected none, zip, piz or dwaa)!", name);
+}
+
 NORI_NAMESPACE_END
@@ -9,11 +9,17 @@
 #include <nori/rfilter.h>
 #include <nori/bbox.h>
 #include <tbb/tbb.h>
+#include <thread>
+
+/* Number of rows protected by each lock of ImageBlock::put(ImageBlock &) */
+#define NORI_LOCK_ROWS 4
 
 NORI_NAMESPACE_BEGIN
 
-ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter) 
-        : m_offset(0, 0), m_size(size) {
+ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter,
+                       const AOVList &aovs)
+        : m_offset(0, 0), m_size(size), m_aovs(aovs), m_aovChannels(aovs.getChannelCount()),
+          m_idChannel(aovs.getChannelIndex(AOVList::EObjectID)) {
     if (filter) {
         /* Tabulate the image reconstruction filter for performance reasons */
         m_filterRadius = filter->getRadius();
@@ -30,14 +36,37 @@ ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter)
         m_weightsY = new float[weightSize];
         memset(m_weightsX, 0, sizeof(float) * weightSize);
         memset(m_weightsY, 0, sizeof(float) * weightSize);
+
+        if (filter->isImportanceSampled()) {
+            /* Samples only contribute to a single pixel -- no border is needed.
+               Tabulate the CDF of |filter| for sampling sample offsets */
+            m_borderSize = 0;
+            m_filterCDF = new float[NORI_FILTER_RESOLUTION + 1];
+            m_filterCDF[0] = 0.0f;
+            for (int i=0; i<NORI_FILTER_RESOLUTION; ++i)
+                m_filterCDF[i+1] = m_filterCDF[i] + std::abs(m_filter[i]);
+            for (int i=1; i<=NORI_FILTER_RESOLUTION; ++i)
+                m_filterCDF[i] /= m_filterCDF[NORI_FILTER_RESOLUTION];
+        }
     }
 
     /* Allocate space for pixels and border regions */
     resize(size.y() + 2*m_borderSize, size.x() + 2*m_borderSize);
+    m_aovData.resize(rows(), cols() * m_aovChannels);
+    m_aovValues.resize(m_aovChannels);
+    m_rowLocks.reset(new tbb::spin_mutex[rows() / NORI_LOCK_ROWS + 1]);
+
+    m_dirtyTiles = Vector2i(
+        ((int) cols() + NORI_DIRTY_TILE_SIZE - 1) / NORI_DIRTY_TILE_SIZE,
+        ((int) rows() + NORI_DIRTY_TILE_SIZE - 1) / NORI_DIRTY_TILE_SIZE);
+    m_dirty.reset(new std::atomic<uint8_t>[m_dirtyTiles.x() * m_dirtyTiles.y()]);
+    for (int i = 0; i < m_dirtyTiles.x() * m_dirtyTiles.y(); ++i)
+        m_dirty[i].store(1, std::memory_order_relaxed);
 }
 
 ImageBlock::~ImageBlock() {
     delete[] m_filter;
+    delete[] m_filterCDF;
     delete[] m_weightsX;
     delete[] m_weightsY;
 }
@@ -47,6 +76,35 @@ Bitmap *ImageBlock::toBitmap() const {
     for (int y=0; y<m_size.y(); ++y)
         for (int x=0; x<m_size.x(); ++x)
             result->coeffRef(y, x) = coeff(y + m_borderSize, x + m_borderSize).divideByFilterWeight();
+
+    const std::vector<std::string> &names = m_aovs.getChannelNames();
+    for (int c=0; c<m_aovChannels; ++c) {
+        Bitmap::Channel &channel = result->addChannel(names[c]);
+        for (int y=0; y<m_size.y(); ++y)
+            for (int x=0; x<m_size.x(); ++x)
+                channel.data(y, x) = getAOV(x, y, c);
+    }
+    return result;
+}
+
+Bitmap *ImageBlock::toUnnormalizedBitmap() const {
+    Bitmap *result = new Bitmap(m_size);
+    Bitmap::Channel &weight = result->addChannel("filterWeight");
+    for (int y=0; y<m_size.y(); ++y) {
+        for (int x=0; x<m_size.x(); ++x) {
+            const Color4f &value = coeff(y + m_borderSize, x + m_borderSize);
+            result->coeffRef(y, x) = Color3f(value.x(), value.y(), value.z());
+            weight.data(y, x) = value.w();
+        }
+    }
+
+    const std::vector<std::string> &names = m_aovs.getChannelNames();
+    for (int c=0; c<m_aovChannels; ++c) {
+        Bitmap::Channel &channel = result->addChannel(names[c]);
+        for (int y=0; y<m_size.y(); ++y)
+            for (int x=0; x<m_size.x(); ++x)
+                channel.data(y, x) = m_aovData(y + m_borderSize, (x + m_borderSize) * m_aovChannels + c);
+    }
     return result;
 }
 
@@ -57,9 +115,10 @@ void ImageBlock::fromBitmap(const Bitmap &bitmap) {
     for (int y=0; y<m_size.y(); ++y)
         for (int x=0; x<m_size.x(); ++x)
             coeffRef(y, x) << bitmap.coeff(y, x), 1;
+    markDirty(Point2i(0, 0), Point2i(cols(), rows()));
 }
 
-void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
+void ImageBlock::put(const Point2f &_pos, const Color3f &value, const AOVRecord *aov) {
     if (!value.isValid()) {
         /* If this happens, go fix your code instead of removing this warning ;) */
         cerr << "Integrator: computed an invalid radiance value: " << value.toString() << endl;
@@ -88,17 +147,265 @@ void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
     for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) 
         for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) 
             coeffRef(y, x) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
+
+    if (m_aovChannels == 0)
+        return;
+
+    /* Splat the output variables using the same weights */
+    if (aov)
+        m_aovs.write(*aov, m_aovValues.data());
+    else
+        std::fill(m_aovValues.begin(), m_aovValues.end(), 0.0f);
+
+    /* .. except for the object ID, which only goes to the pixel containing the sample */
+    float objectID = 0.0f;
+    if (m_idChannel >= 0)
+        std::swap(objectID, m_aovValues[m_idChannel]);
+
+    for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) {
+        for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) {
+            float weight = m_weightsX[xr] * m_weightsY[yr];
+            float *target = &m_aovData(y, x * m_aovChannels);
+            for (int c=0; c<m_aovChannels; ++c)
+                target[c] += m_aovValues[c] * weight;
+        }
+    }
+
+    if (objectID != 0) {
+        int x = (int) std::floor(_pos.x()) - m_offset.x() + m_borderSize,
+            y = (int) std::floor(_pos.y()) - m_offset.y() + m_borderSize;
+        if (x >= 0 && y >= 0 && x < cols() && y < rows())
+            m_aovData(y, x * m_aovChannels + m_idChannel) += objectID;
+    }
 }
     
+void ImageBlock::put(const Point2f *positions, const Color3f *values, size_t count) {
+    int weightSize = (int) std::ceil(2*m_filterRadius) + 1;
+    int maxX = (int) cols() - 1, maxY = (int) rows() - 1;
+    float offsetX = (float) (m_offset.x() - m_borderSize),
+          offsetY = (float) (m_offset.y() - m_borderSize);
+
+    m_batchPos.resize(2 * count);
+    m_batchBounds.resize(4 * count);
+    m_batchWeights.resize(2 * count * weightSize);
+    float *posX = m_batchPos.data(), *posY = posX + count;
+    int *minX = m_batchBounds.data(), *minY = minX + count,
+        *bboxMaxX = minY + count, *bboxMaxY = bboxMaxX + count;
+    float *weightsX = m_batchWeights.data(),
+          *weightsY = weightsX + count * weightSize;
+
+    /* Convert to pixel coordinates within the image block and compute
+       the clipped rectangles of pixels that will need to be updated.
+       These loops have no dependencies between samples and are
+       vectorized by the compiler. */
+    for (size_t i=0; i<count; ++i) {
+        posX[i] = positions[i].x() - 0.5f - offsetX;
+        posY[i] = positions[i].y() - 0.5f - offsetY;
+    }
+    for (size_t i=0; i<count; ++i) {
+        minX[i] = std::max((int) std::ceil(posX[i] - m_filterRadius), 0);
+        minY[i] = std::max((int) std::ceil(posY[i] - m_filterRadius), 0);
+        bboxMaxX[i] = std::min((int) std::floor(posX[i] + m_filterRadius), maxX);
+        bboxMaxY[i] = std::min((int) std::floor(posY[i] + m_filterRadius), maxY);
+    }
+
+    /* Lookup values from the pre-rasterized filter (unused entries are zero) */
+    for (size_t i=0; i<count; ++i) {
+        for (int k=0; k<weightSize; ++k) {
+            int x = minX[i] + k, y = minY[i] + k;
+            weightsX[i * weightSize + k] = x <= bboxMaxX[i] ?
+                m_filter[(int) (std::abs(x-posX[i]) * m_lookupFactor)] : 0.0f;
+            weightsY[i * weightSize + k] = y <= bboxMaxY[i] ?
+                m_filter[(int) (std::abs(y-posY[i]) * m_lookupFactor)] : 0.0f;
+        }
+    }
+
+    /* Accumulate in sample order, using the same arithmetic as
+       put(const Point2f &, const Color3f &) -- the results are identical */
+    for (size_t i=0; i<count; ++i) {
+        if (!values[i].isValid()) {
+            /* If this happens, go fix your code instead of removing this warning ;) */
+            cerr << "Integrator: computed an invalid radiance value: " << values[i].toString() << endl;
+            continue;
+        }
+
+        const float *wx = weightsX + i * weightSize, *wy = weightsY + i * weightSize;
+        for (int y=minY[i], yr=0; y<=bboxMaxY[i]; ++y, ++yr)
+            for (int x=minX[i], xr=0; x<=bboxMaxX[i]; ++x, ++xr)
+                coeffRef(y, x) += Color4f(values[i]) * wx[xr] * wy[yr];
+    }
+}
+
+Point2f ImageBlock::sampleFilter(const Point2f &sample, float &weight) const {
+    Point2f offset;
+    weight = 1.0f;
+
+    for (int dim=0; dim<2; ++dim) {
+        /* Reuse the sample to choose the side of the symmetric filter */
+        float u = sample[dim], sign = 1.0f;
+        if (u < 0.5f) {
+            u = 2.0f * u;
+            sign = -1.0f;
+        } else {
+            u = 2.0f * u - 1.0f;
+        }
+
+        /* Find the interval of the piecewise constant tabulated filter */
+        int idx = (int) (std::upper_bound(m_filterCDF, m_filterCDF + NORI_FILTER_RESOLUTION + 1, u)
+                         - m_filterCDF) - 1;
+        idx = clamp(idx, 0, NORI_FILTER_RESOLUTION - 1);
+        float width = m_filterCDF[idx+1] - m_filterCDF[idx];
+        float t = width > 0 ? (u - m_filterCDF[idx]) / width : 0.5f;
+
+        offset[dim] = sign * (idx + t) * m_filterRadius / NORI_FILTER_RESOLUTION;
+
+        /* Negative filter lobes (e.g. Mitchell-Netravali) yield negative weights */
+        if (m_filter[idx] < 0)
+            weight = -weight;
+    }
+
+    return offset;
+}
+
+void ImageBlock::put(const Point2i &pixel, const Color3f &value, float weight,
+                     const AOVRecord *aov) {
+    if (!value.isValid()) {
+        /* If this happens, go fix your code instead of removing this warning ;) */
+        cerr << "Integrator: computed an invalid radiance value: " << value.toString() << endl;
+        return;
+    }
+
+    Point2i pos = pixel - m_offset + Vector2i::Constant(m_borderSize);
+    if (pos.x() < 0 || pos.y() < 0 || pos.x() >= cols() || pos.y() >= rows())
+        return;
+
+    coeffRef(pos.y(), pos.x()) += Color4f(value) * weight;
+
+    if (m_aovChannels > 0 && aov) {
+        m_aovs.write(*aov, m_aovValues.data());
+        float *target = &m_aovData(pos.y(), pos.x() * m_aovChannels);
+        for (int c=0; c<m_aovChannels; ++c)
+            target[c] += m_aovValues[c] * (c == m_idChannel ? 1.0f : weight);
+    }
+}
+
 void ImageBlock::put(ImageBlock &b) {
     Vector2i offset = b.getOffset() - m_offset +
         Vector2i::Constant(m_borderSize - b.getBorderSize());
     Vector2i size   = b.getSize()   + Vector2i(2*b.getBorderSize());
 
-    tbb::mutex::scoped_lock lock(m_mutex);
+    /* Width of the ring of pixels that may overlap other blocks. Columns
+       of blocks that are at most twice as wide as the border (e.g. at the
+       image edge or after splitting the tail) all lie in this ring */
+    int ring = 2 * b.getBorderSize();
+    bool lockRows = b.getSize().x() <= ring;
+
+    /* Output variables are only merged if both blocks store the same ones */
+    int channels = m_aovChannels == b.m_aovChannels ? m_aovChannels : 0;
+
+    for (int y = 0; y < size.y(); ++y) {
+        int dy = offset.y() + y;
+        auto dst = block(dy, offset.x(), 1, size.x());
+        auto src = b.block(y, 0, 1, size.x());
+        auto dstAOV = m_aovData.block(dy, offset.x() * channels, 1, size.x() * channels);
+        auto srcAOV = b.m_aovData.block(y, 0, 1, size.x() * channels);
+
+        if (lockRows || y < ring || y >= size.y() - ring) {
+            /* Top or bottom part of the ring (or a narrow block): lock the entire row */
+            tbb::spin_mutex::scoped_lock lock(m_rowLocks[dy / NORI_LOCK_ROWS]);
+            dst += src;
+            dstAOV += srcAOV;
+        } else {
+            /* Interior row: only the left and right ends are shared */
+            if (ring > 0) {
+                tbb::spin_mutex::scoped_lock lock(m_rowLocks[dy / NORI_LOCK_ROWS]);
+                dst.leftCols(ring) += src.leftCols(ring);
+                dst.rightCols(ring) += src.rightCols(ring);
+                dstAOV.leftCols(ring * channels) += srcAOV.leftCols(ring * channels);
+                dstAOV.rightCols(ring * channels) += srcAOV.rightCols(ring * channels);
+            }
+            int inner = size.x() - 2 * ring;
+            dst.middleCols(ring, inner) += src.middleCols(ring, inner);
+            dstAOV.middleCols(ring * channels, inner * channels) +=
+                srcAOV.middleCols(ring * channels, inner * channels);
+        }
+    }
+
+    markDirty(offset, offset + size);
+}
+
+void ImageBlock::add(const ImageBlock &b) {
+    Vector2i border = Vector2i::Constant(m_borderSize), bBorder = Vector2i::Constant(b.m_borderSize);
+    Point2i min = (b.m_offset - bBorder).cwiseMax(m_offset - border);
+    Point2i max = (b.m_offset + b.m_size + bBorder).cwiseMin(m_offset + m_size + border);
+    if ((max.array() <= min.array()).any())
+        return;
+
+    Vector2i size = max - min;
+    Point2i src = min - b.m_offset + bBorder, dst = min - m_offset + border;
+    block(dst.y(), dst.x(), size.y(), size.x()) += b.block(src.y(), src.x(), size.y(), size.x());
+
+    int channels = m_aovChannels == b.m_aovChannels ? m_aovChannels : 0;
+    m_aovData.block(dst.y(), dst.x() * channels, size.y(), size.x() * channels) +=
+        b.m_aovData.block(src.y(), src.x() * channels, size.y(), size.x() * channels);
+
+    markDirty(dst, dst + size);
+}
+
+void ImageBlock::serialize(std::ostream &stream) const {
+    int32_t header[3] = { (int32_t) rows(), (int32_t) cols(), (int32_t) m_aovChannels };
+    stream.write(reinterpret_cast<const char *>(header), sizeof(header));
+    stream.write(reinterpret_cast<const char *>(data()), sizeof(Color4f) * size());
+    stream.write(reinterpret_cast<const char *>(m_aovData.data()), sizeof(float) * m_aovData.size());
+}
+
+void ImageBlock::unserialize(std::istream &stream) {
+    int32_t header[3];
+    stream.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (!stream || header[0] != rows() || header[1] != cols() || header[2] != m_aovChannels)
+        throw NoriException("ImageBlock::unserialize(): the stored image has a different layout!");
+    stream.read(reinterpret_cast<char *>(data()), sizeof(Color4f) * size());
+    stream.read(reinterpret_cast<char *>(m_aovData.data()), sizeof(float) * m_aovData.size());
+    if (!stream)
+        throw NoriException("ImageBlock::unserialize(): unexpected end of stream!");
+    markDirty(Point2i(0, 0), Point2i(cols(), rows()));
+}
+
+std::vector<BoundingBox2i> ImageBlock::fetchDirtyTiles() const {
+    std::vector<BoundingBox2i> tiles;
+    for (int y = 0; y < m_dirtyTiles.y(); ++y) {
+        for (int x = 0; x < m_dirtyTiles.x(); ++x) {
+            if (!m_dirty[y * m_dirtyTiles.x() + x].exchange(0, std::memory_order_acquire))
+                continue;
+            Point2i min(x * NORI_DIRTY_TILE_SIZE, y * NORI_DIRTY_TILE_SIZE);
+            Point2i max = (min + Vector2i::Constant(NORI_DIRTY_TILE_SIZE))
+                .cwiseMin(Point2i((int) cols(), (int) rows()));
+            tiles.push_back(BoundingBox2i(min, max));
+        }
+    }
+    return tiles;
+}
 
-    block(offset.y(), offset.x(), size.y(), size.x()) 
-        += b.topLeftCorner(size.y(), size.x());
+void ImageBlock::enableSnapshot() {
+    m_snapshot = *this;
+}
+
+void ImageBlock::updateSnapshot(const Point2i &min, const Point2i &max) {
+    Point2i lo = min.cwiseMax(Point2i(0, 0)), hi = max.cwiseMin(Point2i((int) cols(), (int) rows()));
+    for (int y = lo.y(); y < hi.y(); ++y) {
+        /* Other threads only write to this row while holding its lock */
+        tbb::spin_mutex::scoped_lock lock(m_rowLocks[y / NORI_LOCK_ROWS]);
+        m_snapshot.block(y, lo.x(), 1, hi.x() - lo.x()) = block(y, lo.x(), 1, hi.x() - lo.x());
+    }
+}
+
+void ImageBlock::readSnapshot(const BoundingBox2i &region, Color4f *target) const {
+    int width = region.max.x() - region.min.x();
+    for (int y = region.min.y(); y < region.max.y(); ++y) {
+        tbb::spin_mutex::scoped_lock lock(m_rowLocks[y / NORI_LOCK_ROWS]);
+        const Color4f *row = m_snapshot.data() + (size_t) y * m_snapshot.cols() + region.min.x();
+        target = std::copy(row, row + width, target);
+    }
 }
 
 std::string ImageBlock::toString() const {
@@ -106,49 +413,191 @@ std::string ImageBlock::toString() const {
         m_offset.toString(), m_size.toString());
 }
 
-BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize)
-        : m_size(size), m_blockSize(blockSize) {
+MomentBuffer::MomentBuffer(const Vector2i &size)
+    : m_size(size), m_moments((size_t) size.x() * (size_t) size.y()) { }
+
+float MomentBuffer::getRelativeError(const Point2i &pixel) const {
+    const Moments &m = m_moments[pixel.y() * m_size.x() + pixel.x()];
+    if (m.count < 2)
+        return std::numeric_limits<float>::infinity();
+
+    double mean = m.sum / m.count;
+    double variance = std::max(0.0, (m.sumSq - m.count * mean * mean) / (m.count - 1));
+
+    return (float) (std::sqrt(variance / m.count) / std::max(mean, 1e-2));
+}
+
+float MomentBuffer::getVariance(const Point2i &pixel) const {
+    const Moments &m = m_moments[pixel.y() * m_size.x() + pixel.x()];
+    if (m.count < 2)
+        return std::numeric_limits<float>::infinity();
+
+    double mean = m.sum / m.count;
+    double variance = std::max(0.0, (m.sumSq - m.count * mean * mean) / (m.count - 1));
+    return (float) (variance / m.count);
+}
+
+uint64_t MomentBuffer::getTotalSampleCount() const {
+    uint64_t total = 0;
+    for (const Moments &m : m_moments)
+        total += m.count;
+    return total;
+}
+
+Bitmap *MomentBuffer::toBitmap() const {
+    Bitmap *result = new Bitmap(m_size);
+    for (int y=0; y<m_size.y(); ++y)
+        for (int x=0; x<m_size.x(); ++x)
+            result->coeffRef(y, x) = Color3f((float) getSampleCount(Point2i(x, y)));
+    return result;
+}
+
+void MomentBuffer::serialize(std::ostream &stream) const {
+    int32_t header[2] = { m_size.x(), m_size.y() };
+    stream.write(reinterpret_cast<const char *>(header), sizeof(header));
+    stream.write(reinterpret_cast<const char *>(m_moments.data()), sizeof(Moments) * m_moments.size());
+}
+
+void MomentBuffer::unserialize(std::istream &stream) {
+    int32_t header[2];
+    stream.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (!stream || header[0] != m_size.x() || header[1] != m_size.y())
+        throw NoriException("MomentBuffer::unserialize(): the stored statistics have a different size!");
+    stream.read(reinterpret_cast<char *>(m_moments.data()), sizeof(Moments) * m_moments.size());
+    if (!stream)
+        throw NoriException("MomentBuffer::unserialize(): unexpected end of stream!");
+}
+
+BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize,
+                               EBlockOrder order, int splitTail, const Point2i &offset)
+        : m_offset(offset), m_size(size), m_blockSize(blockSize), m_next(0) {
     m_numBlocks = Vector2i(
         (int) std::ceil(size.x() / (float) blockSize),
         (int) std::ceil(size.y() / (float) blockSize));
-    m_blocksLeft = m_numBlocks.x() * m_numBlocks.y();
-    m_direction = ERight;
-    m_block = Point2i(m_numBlocks / 2);
-    m_stepsLeft = 1;
-    m_numSteps = 1;
-}
+    m_blocks.reserve(m_numBlocks.x() * m_numBlocks.y());
 
-bool BlockGenerator::next(ImageBlock &block) {
-    tbb::mutex::scoped_lock lock(m_mutex);
+    switch (order) {
+        case ESpiral: {
+                Point2i block(m_numBlocks / 2);
+                int direction = ERight, numSteps = 1, stepsLeft = 1;
+                int blocksLeft = m_numBlocks.x() * m_numBlocks.y();
 
-    if (m_blocksLeft == 0)
-        return false;
+                while (blocksLeft > 0) {
+                    if ((block.array() >= 0).all() &&
+                        (block.array() < m_numBlocks.array()).all()) {
+                        addBlock(block);
+                        --blocksLeft;
+                    }
 
-    Point2i pos = m_block * m_blockSize;
-    block.setOffset(pos);
-    block.setSize((m_size - pos).cwiseMin(Vector2i::Constant(m_blockSize)));
+                    switch (direction) {
+                        case ERight: ++block.x(); break;
+                        case EDown:  ++block.y(); break;
+                        case ELeft:  --block.x(); break;
+                        case EUp:    --block.y(); break;
+                    }
 
-    if (--m_blocksLeft == 0)
-        return true;
+                    if (--stepsLeft == 0) {
+                        direction = (direction + 1) % 4;
+                        if (direction == ELeft || direction == ERight)
+                            ++numSteps;
+                        stepsLeft = numSteps;
+                    }
+                }
+            }
+            break;
 
-    do {
-        switch (m_direction) {
-            case ERight: ++m_block.x(); break;
-            case EDown:  ++m_block.y(); break;
-            case ELeft:  --m_block.x(); break;
-            case EUp:    --m_block.y(); break;
-        }
+        case EHilbert: {
+                /* Walk a Hilbert curve over the smallest enclosing
+                   power-of-two grid and skip blocks outside the image */
+                int n = 1;
+                while (n < m_numBlocks.maxCoeff())
+                    n *= 2;
+
+                for (int d = 0; d < n * n; ++d) {
+                    int x = 0, y = 0, t = d;
+                    for (int s = 1; s < n; s *= 2) {
+                        int rx = 1 & (t / 2), ry = 1 & (t ^ rx);
+                        if (ry == 0) {
+                            if (rx == 1) {
+                                x = s - 1 - x;
+                                y = s - 1 - y;
+                            }
+                            std::swap(x, y);
+                        }
+                        x += s * rx;
+                        y += s * ry;
+                        t /= 4;
+                    }
+                    if (x < m_numBlocks.x() && y < m_numBlocks.y())
+                        addBlock(Point2i(x, y));
+                }
+            }
+            break;
 
-        if (--m_stepsLeft == 0) {
-            m_direction = (m_direction + 1) % 4;
-            if (m_direction == ELeft || m_direction == ERight) 
-                ++m_numSteps;
-            m_stepsLeft = m_numSteps;
+        case EScanline:
+            for (int y = 0; y < m_numBlocks.y(); ++y)
+                for (int x = 0; x < m_numBlocks.x(); ++x)
+                    addBlock(Point2i(x, y));
+            break;
+
+        default:
+            throw NoriException("BlockGenerator: unknown block order!");
+    }
+
+    /* Split the last blocks into quadrants to reduce tail latency */
+    if (splitTail < 0)
+        splitTail = (int) std::thread::hardware_concurrency();
+    splitTail = std::min(splitTail, (int) m_blocks.size());
+    if (blockSize >= 8 && splitTail > 0) {
+        std::vector<Block> tail(m_blocks.end() - splitTail, m_blocks.end());
+        m_blocks.resize(m_blocks.size() - splitTail);
+
+        int half = blockSize / 2;
+        for (const Block &b : tail) {
+            for (int y = 0; y < b.size.y(); y += half) {
+                for (int x = 0; x < b.size.x(); x += half) {
+                    Block sub;
+                    sub.offset = b.offset + Vector2i(x, y);
+                    sub.size = (b.size - Vector2i(x, y)).cwiseMin(Vector2i::Constant(half));
+                    m_blocks.push_back(sub);
+                }
+            }
         }
-    } while ((m_block.array() < 0).any() ||
-             (m_block.array() >= m_numBlocks.array()).any());
+    }
+}
+
+void BlockGenerator::addBlock(const Point2i &block) {
+    Block b;
+    b.offset = block * m_blockSize;
+    b.size = (m_size - b.offset).cwiseMin(Vector2i::Constant(m_blockSize));
+    m_blocks.push_back(b);
+}
 
+bool BlockGenerator::next(ImageBlock &block) {
+    int index = m_next.fetch_add(1, std::memory_order_relaxed);
+    if (index >= (int) m_blocks.size())
+        return false;
+
+    block.setOffset(m_offset + m_blocks[index].offset);
+    block.setSize(m_blocks[index].size);
     return true;
 }
 
+void BlockGenerator::shard(int index, int count) {
+    std::vector<Block> blocks;
+    for (size_t i = (size_t) index; i < m_blocks.size(); i += count)
+        blocks.push_back(m_blocks[i]);
+    m_blocks.swap(blocks);
+}
+
+BlockGenerator::EBlockOrder BlockGenerator::parseOrder(const std::string &name) {
+    if (name == "spiral")
+        return ESpiral;
+    else if (name == "hilbert")
+        return EHilbert;
+    else if (name == "scanline")
+        return EScanline;
+    throw NoriException("Unknown block order \"%s\" (expected spiral, hilbert or scanline)!", name);
+}
+
 NORI_NAMESPACE_END
@@ -88,6 +88,10 @@ public:
         return true;
     }
 
+    Color3f getAlbedo(const Intersection &si) const {
+        return m_albedo->eval(si);
+    }
+
     /// Return a human-readable summary
     std::string toString() const {
         return tfm::format(
@@ -105,6 +105,10 @@ public:
         return true;
     }
 
+    Color3f getAlbedo(const Intersection &) const {
+        return m_kd + Color3f(m_ks);
+    }
+
     std::string toString() const {
         return tfm::format(
             "Microfacet[\n"
@@ -61,6 +61,10 @@ public:
         return m_nested_bsdf->isDiffuse();
     }
 
+    Color3f getAlbedo(const Intersection &si) const {
+        return m_nested_bsdf->getAlbedo(si);
+    }
+
     /// Return a human-readable summary
     std::string toString() const {
         return tfm::format(
@@ -0,0 +1,57 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/camerapath.h>
+#include <fstream>
+#include <sstream>
+
+NORI_NAMESPACE_BEGIN
+
+CameraPath::CameraPath(const std::string &filename) {
+    std::ifstream is(filename);
+    if (!is)
+        throw NoriException("Unable to open the camera path \"%s\"!", filename);
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(is, line)) {
+        lineNumber++;
+        std::istringstream tokens(line);
+        std::string type;
+        if (!(tokens >> type) || type[0] == '#')
+            continue;
+
+        Eigen::Matrix4f trafo;
+        if (type == "lookat") {
+            Vector3f origin, target, up;
+            if (!(tokens >> origin.x() >> origin.y() >> origin.z()
+                         >> target.x() >> target.y() >> target.z()
+                         >> up.x() >> up.y() >> up.z()))
+                throw NoriException("\"%s\", line %i: \"lookat\" expects 9 numbers!", filename, lineNumber);
+
+            /* Same convention as the 'lookat' tag of the XML parser */
+            Vector3f dir = (target - origin).normalized();
+            Vector3f left = up.normalized().cross(dir).normalized();
+            Vector3f newUp = dir.cross(left).normalized();
+            trafo << left, newUp, dir, origin,
+                     0, 0, 0, 1;
+        } else if (type == "matrix") {
+            for (int i = 0; i < 16; ++i) {
+                if (!(tokens >> trafo(i / 4, i % 4)))
+                    throw NoriException("\"%s\", line %i: \"matrix\" expects 16 numbers!", filename, lineNumber);
+            }
+        } else {
+            throw NoriException("\"%s\", line %i: unknown keyword \"%s\" (expected lookat or matrix)",
+                                filename, lineNumber, type);
+        }
+        m_frames.push_back(Transform(trafo));
+    }
+
+    if (m_frames.empty())
+        throw NoriException("The camera path \"%s\" doesn't contain any frames!", filename);
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,98 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/checkpoint.h>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+
+#define NORI_CHECKPOINT_MAGIC "NORICKPT"
+#define NORI_CHECKPOINT_VERSION 1
+
+NORI_NAMESPACE_BEGIN
+
+bool Checkpoint::save(const ImageBlock &result, const MomentBuffer *moments,
+                      uint64_t sampleCount, int passes) {
+    if (m_busy)
+        return false;
+
+    /* Serialize the state while the render threads are between passes */
+    std::ostringstream snapshot(std::ios::binary);
+    int32_t version = NORI_CHECKPOINT_VERSION, completedPasses = passes;
+    uint8_t hasMoments = moments ? 1 : 0;
+    snapshot.write(NORI_CHECKPOINT_MAGIC, 8);
+    snapshot.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    snapshot.write(reinterpret_cast<const char *>(&sampleCount), sizeof(sampleCount));
+    snapshot.write(reinterpret_cast<const char *>(&completedPasses), sizeof(completedPasses));
+    snapshot.write(reinterpret_cast<const char *>(&hasMoments), sizeof(hasMoments));
+    result.serialize(snapshot);
+    if (moments)
+        moments->serialize(snapshot);
+
+    /* The previous write has finished, reap its thread */
+    if (m_thread.joinable())
+        m_thread.join();
+
+    m_busy = true;
+    m_thread = std::thread([this, data = snapshot.str()] {
+        std::string tmpName = m_filename + ".tmp";
+        std::ofstream file(tmpName, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        file.close();
+
+        if (!file) {
+            cerr << "Checkpoint: could not write \"" << tmpName << "\"!" << endl;
+        } else {
+            /* Atomically replace the previous checkpoint. rename() doesn't
+               overwrite existing files on Windows, where the previous
+               checkpoint has to be removed first. */
+#if defined(_WIN32)
+            std::remove(m_filename.c_str());
+#endif
+            if (std::rename(tmpName.c_str(), m_filename.c_str()) != 0)
+                cerr << "Checkpoint: could not rename \"" << tmpName << "\"!" << endl;
+        }
+        m_busy = false;
+    });
+
+    return true;
+}
+
+bool Checkpoint::load(ImageBlock &result, MomentBuffer *moments,
+                      uint64_t &sampleCount, int &passes) const {
+    std::ifstream file(m_filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    char magic[8];
+    int32_t version, completedPasses;
+    uint8_t hasMoments;
+    file.read(magic, 8);
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    if (!file || memcmp(magic, NORI_CHECKPOINT_MAGIC, 8) != 0 || version != NORI_CHECKPOINT_VERSION)
+        throw NoriException("\"%s\" is not a valid checkpoint!", m_filename);
+    file.read(reinterpret_cast<char *>(&sampleCount), sizeof(sampleCount));
+    file.read(reinterpret_cast<char *>(&completedPasses), sizeof(completedPasses));
+    file.read(reinterpret_cast<char *>(&hasMoments), sizeof(hasMoments));
+
+    if ((hasMoments != 0) != (moments != nullptr))
+        throw NoriException("The checkpoint \"%s\" was %s adaptive sampling!",
+            m_filename, hasMoments ? "rendered with" : "not rendered with");
+
+    result.unserialize(file);
+    if (moments)
+        moments->unserialize(file);
+    passes = completedPasses;
+    return true;
+}
+
+void Checkpoint::wait() {
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+NORI_NAMESPACE_END
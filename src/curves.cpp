@@ -0,0 +1,365 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+#include <fstream>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Cubic Bezier curves (e.g. for hair and fur)
+ *
+ * Loads a list of cubic Bezier segments from a text file containing one
+ * segment per line: 12 numbers specifying the four control points, which
+ * may optionally be followed by two more numbers specifying the width at
+ * the start and at the end of the segment. Lines starting with '#' are
+ * ignored. The following parameters are supported:
+ *
+ * - \c filename: the curve file
+ * - \c toWorld: transformation applied to the control points
+ * - \c width / \c widthStart / \c widthEnd: default (tapered) width
+ *   in world space units, used when the file provides none
+ * - \c mode: \c flat for ribbons that always face the incident ray, or
+ *   \c cylinder for ribbons that are shaded like a thin round tube
+ * - \c subdivisions: every segment is split into <tt>2^subdivisions</tt>
+ *   pieces that are inserted into the BVH with separate (tighter) bounds
+ *
+ * Only the control points and widths are stored, which is far more compact
+ * than a tessellated ribbon mesh. The intersection routine follows the
+ * recursive subdivision approach of pbrt (Physically Based Rendering, 3rd
+ * edition, Section 3.7): the segment is transformed into a coordinate
+ * system where the ray runs along the +z axis and then split until it is
+ * flat enough to be approximated by a line.
+ *
+ * Curves cannot be used as area emitters.
+ */
+class BezierCurves : public Mesh {
+public:
+    BezierCurves(const PropertyList &propList) {
+        filesystem::path filename =
+            getFileResolver()->resolve(propList.getString("filename"));
+
+        std::ifstream is(filename.str());
+        if (is.fail())
+            throw NoriException("Unable to open curve file \"%s\"!", filename);
+        Transform trafo = propList.getTransform("toWorld", Transform());
+
+        float width = propList.getFloat("width", 0.01f);
+        float widthStart = propList.getFloat("widthStart", width);
+        float widthEnd = propList.getFloat("widthEnd", width);
+
+        std::string mode = propList.getString("mode", "flat");
+        if (mode == "flat")
+            m_cylinder = false;
+        else if (mode == "cylinder")
+            m_cylinder = true;
+        else
+            throw NoriException("BezierCurves: unknown mode \"%s\"!", mode);
+
+        m_subdivisions = propList.getInteger("subdivisions", 2);
+        if (m_subdivisions < 0 || m_subdivisions > 8)
+            throw NoriException("BezierCurves: 'subdivisions' must be in [0, 8]!");
+
+        cout << "Loading \"" << filename << "\" .. ";
+        cout.flush();
+        Timer timer;
+
+        std::string line_str;
+        uint32_t lineNumber = 0;
+        while (std::getline(is, line_str)) {
+            ++lineNumber;
+            size_t first = line_str.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line_str[first] == '#')
+                continue;
+
+            std::istringstream line(line_str);
+            std::vector<float> values;
+            float value;
+            while (line >> value)
+                values.push_back(value);
+
+            if (values.size() != 12 && values.size() != 14)
+                throw NoriException("BezierCurves: line %i of \"%s\" must contain 12 or 14 "
+                                    "numbers (found %i)!", lineNumber, filename, values.size());
+
+            for (int i = 0; i < 4; ++i)
+                m_cp.push_back(trafo * Point3f(values[3*i], values[3*i+1], values[3*i+2]));
+            m_width.push_back(values.size() == 14 ? values[12] : widthStart);
+            m_width.push_back(values.size() == 14 ? values[13] : widthEnd);
+        }
+
+        if (m_width.empty())
+            throw NoriException("BezierCurves: \"%s\" does not contain any curves!", filename);
+
+        for (uint32_t i = 0, n = getPrimitiveCount(); i < n; ++i)
+            m_bbox.expandBy(getBoundingBox(i));
+
+        m_name = filename.str();
+        cout << "done. (C=" << getCurveCount() << ", took "
+             << timer.elapsedString() << " and "
+             << memString(m_cp.size() * sizeof(Point3f) + m_width.size() * sizeof(float))
+             << ")" << endl;
+    }
+
+    void activate() {
+        if (m_emitter)
+            throw NoriException("BezierCurves: curves cannot be used as area emitters!");
+        Mesh::activate();
+    }
+
+    /// Return the number of Bezier segments
+    uint32_t getCurveCount() const { return (uint32_t) m_width.size() / 2; }
+
+    uint32_t getPrimitiveCount() const {
+        return getCurveCount() << m_subdivisions;
+    }
+
+    BoundingBox3f getBoundingBox(uint32_t index) const {
+        Point3f cp[4];
+        float u0, u1, width0, width1;
+        getSegment(index, cp, u0, u1, width0, width1);
+
+        /* The convex hull property of Bezier curves bounds the center line */
+        BoundingBox3f result(cp[0]);
+        for (int i = 1; i < 4; ++i)
+            result.expandBy(cp[i]);
+
+        float radius = 0.5f * std::max(width0, width1);
+        result.min -= Vector3f::Constant(radius);
+        result.max += Vector3f::Constant(radius);
+        return result;
+    }
+
+    BoundingBox3f getBoundingBox(uint32_t index, float) const {
+        return getBoundingBox(index);
+    }
+
+    Point3f getCentroid(uint32_t index) const {
+        return getBoundingBox(index).getCenter();
+    }
+
+    bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const {
+        Point3f cp[4];
+        float u0, u1, width0, width1;
+        getSegment(index, cp, u0, u1, width0, width1);
+
+        /* Transform the control points into a coordinate system, where
+           the ray starts at the origin and runs along the +z axis */
+        float dLength = ray.d.norm();
+        Frame rayFrame(ray.d / dLength);
+        Point3f cpRay[4];
+        for (int i = 0; i < 4; ++i)
+            cpRay[i] = rayFrame.toLocal(cp[i] - ray.o);
+
+        /* Choose the subdivision depth such that the remaining pieces
+           are approximately linear (pbrt, Section 3.7.2) */
+        float L0 = 0.f;
+        for (int i = 0; i < 2; ++i)
+            L0 = std::max(L0, (cpRay[i] - 2.f * cpRay[i + 1] + cpRay[i + 2])
+                .head<2>().cwiseAbs().maxCoeff());
+        float eps = std::max(width0, width1) * 0.05f;
+        int maxDepth = 0;
+        if (L0 > 0.f && eps > 0.f) {
+            float r0 = std::log2(1.41421356237f * 6.f * L0 / (8.f * eps)) / 2.f;
+            maxDepth = clamp((int) std::round(r0), 0, 10);
+        }
+
+        Hit hit;
+        hit.zMin = ray.mint * dLength;
+        hit.zMax = ray.maxt * dLength;
+        if (!recursiveIntersect(cpRay, u0, u1, width0, width1, maxDepth, hit))
+            return false;
+
+        u = hit.u;
+        v = hit.v;
+        t = hit.zMax / dLength;
+        return true;
+    }
+
+    void setHitInformation(uint32_t index, const Ray3f &ray, Intersection &its) const {
+        uint32_t curve = index >> m_subdivisions;
+        const Point3f *cp = &m_cp[4 * curve];
+        float u = its.uv.x();
+
+        its.time = ray.time;
+        its.p = ray(its.t);
+
+        /* Tangent and center of the curve at the hit location */
+        Vector3f tangent;
+        Point3f center = evalBezier(cp, u, &tangent);
+        if (tangent.squaredNorm() == 0.f)
+            tangent = cp[3] - cp[0];
+        tangent.normalize();
+
+        /* The ribbon faces the incident ray */
+        Vector3f n = -ray.d + ray.d.dot(tangent) * tangent;
+        if (n.squaredNorm() == 0.f)
+            n = Frame(tangent).s;
+        n.normalize();
+        its.geoFrame = Frame(n);
+
+        if (m_cylinder) {
+            /* Bend the shading normal around the tangent based on the
+               offset of the hit point from the center line, which
+               mimics the cross section of a thin round tube */
+            float radius = 0.5f * lerp(u, m_width[2 * curve], m_width[2 * curve + 1]);
+            Vector3f side = tangent.cross(n);
+            float s = radius > 0.f ? clamp((its.p - center).dot(side) / radius, -1.f, 1.f) : 0.f;
+            its.shFrame = Frame((s * side + std::sqrt(1.f - s * s) * n).normalized());
+        } else {
+            its.shFrame = its.geoFrame;
+        }
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "BezierCurves[\n"
+            "  name = \"%s\",\n"
+            "  curveCount = %i,\n"
+            "  subdivisions = %i,\n"
+            "  mode = %s,\n"
+            "  bsdf = %s\n"
+            "]",
+            m_name,
+            getCurveCount(),
+            m_subdivisions,
+            m_cylinder ? "cylinder" : "flat",
+            m_bsdf ? indent(m_bsdf->toString()) : std::string("null")
+        );
+    }
+
+protected:
+    /// Closest hit found so far by \ref recursiveIntersect()
+    struct Hit {
+        float zMin, zMax;
+        float u, v;
+    };
+
+    /// Linearly interpolate between two points
+    static Point3f interpolate(float t, const Point3f &p0, const Point3f &p1) {
+        return (1.f - t) * p0 + t * p1;
+    }
+
+    /// Evaluate a cubic Bezier curve (and optionally its derivative)
+    static Point3f evalBezier(const Point3f cp[4], float u, Vector3f *deriv = nullptr) {
+        Point3f cp1[3] = { interpolate(u, cp[0], cp[1]), interpolate(u, cp[1], cp[2]), interpolate(u, cp[2], cp[3]) };
+        Point3f cp2[2] = { interpolate(u, cp1[0], cp1[1]), interpolate(u, cp1[1], cp1[2]) };
+        if (deriv)
+            *deriv = 3.f * (cp2[1] - cp2[0]);
+        return interpolate(u, cp2[0], cp2[1]);
+    }
+
+    /// Compute the control points of the part of a curve between \c u0 and \c u1 (blossoming)
+    static void subCurve(const Point3f cp[4], float u0, float u1, Point3f result[4]) {
+        auto blossom = [&](float a, float b, float c) {
+            Point3f ab[3] = { interpolate(a, cp[0], cp[1]), interpolate(a, cp[1], cp[2]), interpolate(a, cp[2], cp[3]) };
+            Point3f bc[2] = { interpolate(b, ab[0], ab[1]), interpolate(b, ab[1], ab[2]) };
+            return interpolate(c, bc[0], bc[1]);
+        };
+        result[0] = blossom(u0, u0, u0);
+        result[1] = blossom(u0, u0, u1);
+        result[2] = blossom(u0, u1, u1);
+        result[3] = blossom(u1, u1, u1);
+    }
+
+    /// Split a cubic Bezier curve in the middle
+    static void splitBezier(const Point3f cp[4], Point3f result[7]) {
+        result[0] = cp[0];
+        result[1] = 0.5f * (cp[0] + cp[1]);
+        result[2] = 0.25f * (cp[0] + 2.f * cp[1] + cp[2]);
+        result[3] = 0.125f * (cp[0] + 3.f * cp[1] + 3.f * cp[2] + cp[3]);
+        result[4] = 0.25f * (cp[1] + 2.f * cp[2] + cp[3]);
+        result[5] = 0.5f * (cp[2] + cp[3]);
+        result[6] = cp[3];
+    }
+
+    /// Fetch the control points, parameter range and widths of a BVH primitive
+    void getSegment(uint32_t index, Point3f cp[4], float &u0, float &u1,
+                    float &width0, float &width1) const {
+        uint32_t curve = index >> m_subdivisions,
+                 piece = index & ((1u << m_subdivisions) - 1);
+        float scale = 1.f / (float) (1u << m_subdivisions);
+        u0 = piece * scale;
+        u1 = (piece + 1) * scale;
+        subCurve(&m_cp[4 * curve], u0, u1, cp);
+        width0 = lerp(u0, m_width[2 * curve], m_width[2 * curve + 1]);
+        width1 = lerp(u1, m_width[2 * curve], m_width[2 * curve + 1]);
+    }
+
+    /**
+     * \brief Intersect a ray (running along +z) against a curve segment
+     *
+     * \c cp contains the control points of the segment in ray space, which
+     * covers the parameter range [u0, u1] of the original curve. On success,
+     * \c hit is updated with the new closest intersection.
+     */
+    bool recursiveIntersect(const Point3f cp[4], float u0, float u1,
+                            float width0, float width1, int depth, Hit &hit) const {
+        /* Reject segments whose bounding box doesn't overlap the ray */
+        BoundingBox3f bbox(cp[0]);
+        for (int i = 1; i < 4; ++i)
+            bbox.expandBy(cp[i]);
+        float radius = 0.5f * std::max(width0, width1);
+        if (bbox.min.x() - radius > 0.f || bbox.max.x() + radius < 0.f ||
+            bbox.min.y() - radius > 0.f || bbox.max.y() + radius < 0.f ||
+            bbox.min.z() - radius > hit.zMax || bbox.max.z() + radius < hit.zMin)
+            return false;
+
+        if (depth > 0) {
+            Point3f cpSplit[7];
+            splitBezier(cp, cpSplit);
+            float uMid = 0.5f * (u0 + u1), widthMid = 0.5f * (width0 + width1);
+            bool found = recursiveIntersect(cpSplit, u0, uMid, width0, widthMid, depth - 1, hit);
+            found |= recursiveIntersect(cpSplit + 3, uMid, u1, widthMid, width1, depth - 1, hit);
+            return found;
+        }
+
+        /* Reject hits beyond the start and end of the (linearized) segment */
+        float edge = (cp[1].y() - cp[0].y()) * -cp[0].y() + cp[0].x() * (cp[0].x() - cp[1].x());
+        if (edge < 0.f)
+            return false;
+        edge = (cp[2].y() - cp[3].y()) * -cp[3].y() + cp[3].x() * (cp[3].x() - cp[2].x());
+        if (edge < 0.f)
+            return false;
+
+        /* Closest point on the line between the end points */
+        Vector2f segment = (cp[3] - cp[0]).head<2>();
+        float denom = segment.squaredNorm();
+        if (denom == 0.f)
+            return false;
+        float w = clamp(-cp[0].head<2>().dot(segment) / denom, 0.f, 1.f);
+
+        Vector3f dpcdw;
+        Point3f pc = evalBezier(cp, w, &dpcdw);
+        float hitWidth = lerp(w, width0, width1);
+        float dist2 = pc.head<2>().squaredNorm();
+        if (dist2 > 0.25f * hitWidth * hitWidth)
+            return false;
+        if (pc.z() < hit.zMin || pc.z() > hit.zMax)
+            return false;
+
+        /* v runs across the width of the ribbon from 0 to 1 */
+        float dist = std::sqrt(dist2);
+        float edgeFunc = dpcdw.x() * -pc.y() + pc.x() * dpcdw.y();
+
+        hit.zMax = pc.z();
+        hit.u = lerp(w, u0, u1);
+        hit.v = edgeFunc > 0.f ? 0.5f + dist / hitWidth : 0.5f - dist / hitWidth;
+        return true;
+    }
+
+protected:
+    std::vector<Point3f> m_cp;    ///< Control points (4 per segment)
+    std::vector<float> m_width;   ///< Widths at the start and end (2 per segment)
+    int m_subdivisions;           ///< BVH primitives per segment (log2)
+    bool m_cylinder;              ///< Shade as a round tube?
+};
+
+NORI_REGISTER_CLASS(BezierCurves, "curves");
+NORI_NAMESPACE_END
@@ -0,0 +1,234 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/denoiser.h>
+#include <nori/block.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Edge-avoiding a-trous wavelet denoiser
+ *
+ * Based on "Edge-Avoiding A-Trous Wavelet Transform for fast Global
+ * Illumination Filtering" by Dammertz et al. (HPG 2010), with the
+ * variance-guided luminance weights of "Spatiotemporal Variance-Guided
+ * Filtering" by Schied et al. (HPG 2017).
+ *
+ * The image is smoothed by several passes of a 5x5 B-spline kernel whose
+ * taps are spread further apart in every pass. Each tap is weighted by
+ * the similarity of the shading normals and albedos (if the camera
+ * renders the \c normal and \c albedo output variables) and by the
+ * difference in luminance relative to the estimated noise level. When the
+ * albedo is available, it is divided out before filtering and multiplied
+ * back afterwards, so that texture detail is not blurred.
+ *
+ * The noise level of each pixel is estimated from the recorded sample
+ * statistics if available (adaptive sampling), and otherwise from the
+ * luminance variance of its 3x3 neighborhood.
+ *
+ * The following parameters are supported:
+ *
+ * - \c iterations: number of filter passes (default: 5)
+ * - \c sigmaLuminance: tolerance for luminance differences, in standard
+ *   deviations of the noise (default: 4)
+ * - \c sigmaNormal: exponent of the normal similarity (default: 128)
+ * - \c sigmaAlbedo: tolerance for albedo differences (default: 0.1)
+ */
+class ATrousDenoiser : public Denoiser {
+public:
+    ATrousDenoiser(const PropertyList &propList) {
+        m_iterations = propList.getInteger("iterations", 5);
+        m_sigmaLuminance = propList.getFloat("sigmaLuminance", 4.0f);
+        m_sigmaNormal = propList.getFloat("sigmaNormal", 128.0f);
+        m_sigmaAlbedo = propList.getFloat("sigmaAlbedo", 0.1f);
+        if (m_iterations < 1)
+            throw NoriException("ATrousDenoiser: 'iterations' must be positive!");
+    }
+
+    void denoise(ImageBlock &image, const MomentBuffer *moments) const {
+        const Vector2i &size = image.getSize();
+        int border = image.getBorderSize();
+        int albedoChannel = image.getAOVs().getChannelIndex(AOVList::EAlbedo);
+        int normalChannel = image.getAOVs().getChannelIndex(AOVList::ENormal);
+        size_t pixelCount = (size_t) size.x() * (size_t) size.y();
+
+        /* Gather the (demodulated) radiance and the feature buffers */
+        std::vector<Color3f> color(pixelCount), albedo(pixelCount, Color3f(1.0f));
+        std::vector<Vector3f> normal(pixelCount, Vector3f(0.0f));
+        std::vector<float> variance(pixelCount);
+
+        parallelRows(size.y(), [&](int y) {
+            for (int x = 0; x < size.x(); ++x) {
+                size_t i = index(size, x, y);
+                color[i] = image.coeff(y + border, x + border).divideByFilterWeight();
+
+                if (albedoChannel >= 0) {
+                    for (int c = 0; c < 3; ++c)
+                        albedo[i][c] = image.getAOV(x, y, albedoChannel + c);
+                    for (int c = 0; c < 3; ++c)
+                        color[i][c] = albedo[i][c] > 1e-3f ? color[i][c] / albedo[i][c] : color[i][c];
+                }
+
+                if (normalChannel >= 0) {
+                    Vector3f n;
+                    for (int c = 0; c < 3; ++c)
+                        n[c] = image.getAOV(x, y, normalChannel + c);
+                    float length = n.norm();
+                    normal[i] = length > 1e-3f ? Vector3f(n / length) : Vector3f(0.0f);
+                }
+            }
+        });
+
+        /* Estimate the variance of the luminance of every pixel */
+        parallelRows(size.y(), [&](int y) {
+            for (int x = 0; x < size.x(); ++x) {
+                size_t i = index(size, x, y);
+                float var = std::numeric_limits<float>::infinity();
+                if (moments) {
+                    Point2i pixel = image.getOffset() + Vector2i(x, y);
+                    var = moments->getVariance(pixel);
+                    /* The moments refer to the modulated radiance */
+                    float albedoLum = albedo[i].getLuminance();
+                    if (albedoLum > 1e-3f)
+                        var /= albedoLum * albedoLum;
+                }
+                if (!std::isfinite(var)) {
+                    float sum = 0, sumSq = 0;
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            int qx = x + dx, qy = y + dy;
+                            if (qx < 0 || qy < 0 || qx >= size.x() || qy >= size.y())
+                                continue;
+                            float l = color[index(size, qx, qy)].getLuminance();
+                            sum += l;
+                            sumSq += l * l;
+                            count++;
+                        }
+                    }
+                    float mean = sum / count;
+                    var = std::max(0.0f, sumSq / count - mean * mean);
+                }
+                variance[i] = var;
+            }
+        });
+
+        /* Filter passes with increasing tap distance */
+        static const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+        std::vector<Color3f> colorOut(pixelCount);
+        std::vector<float> varianceOut(pixelCount);
+        float invSigmaAlbedo2 = 1.0f / (m_sigmaAlbedo * m_sigmaAlbedo);
+
+        for (int iteration = 0; iteration < m_iterations; ++iteration) {
+            int step = 1 << iteration;
+
+            parallelRows(size.y(), [&](int y) {
+                for (int x = 0; x < size.x(); ++x) {
+                    size_t i = index(size, x, y);
+                    float lum = color[i].getLuminance();
+                    float lumScale = 1.0f / (m_sigmaLuminance * std::sqrt(variance[i]) + 1e-6f);
+
+                    Color3f sumColor(0.0f);
+                    float sumWeight = 0.0f, sumVariance = 0.0f;
+
+                    for (int ky = 0; ky < 5; ++ky) {
+                        int qy = y + (ky - 2) * step;
+                        if (qy < 0 || qy >= size.y())
+                            continue;
+                        for (int kx = 0; kx < 5; ++kx) {
+                            int qx = x + (kx - 2) * step;
+                            if (qx < 0 || qx >= size.x())
+                                continue;
+                            size_t j = index(size, qx, qy);
+
+                            float weight = kernel[kx] * kernel[ky] *
+                                std::exp(-std::abs(lum - color[j].getLuminance()) * lumScale);
+
+                            if (normalChannel >= 0)
+                                weight *= normalWeight(normal[i], normal[j]);
+                            if (albedoChannel >= 0)
+                                weight *= std::exp(-(albedo[i] - albedo[j]).matrix().squaredNorm() * invSigmaAlbedo2);
+
+                            sumColor += color[j] * weight;
+                            sumVariance += weight * weight * variance[j];
+                            sumWeight += weight;
+                        }
+                    }
+
+                    /* The center tap always has a positive weight */
+                    colorOut[i] = sumColor / sumWeight;
+                    varianceOut[i] = sumVariance / (sumWeight * sumWeight);
+                }
+            });
+
+            color.swap(colorOut);
+            variance.swap(varianceOut);
+        }
+
+        /* Remodulate and store, preserving the filter weights of the pixels */
+        parallelRows(size.y(), [&](int y) {
+            for (int x = 0; x < size.x(); ++x) {
+                size_t i = index(size, x, y);
+                Color3f value = color[i];
+                if (albedoChannel >= 0)
+                    for (int c = 0; c < 3; ++c)
+                        value[c] = albedo[i][c] > 1e-3f ? value[c] * albedo[i][c] : value[c];
+
+                Color4f &pixel = image.coeffRef(y + border, x + border);
+                float weight = pixel.w();
+                if (weight != 0)
+                    pixel = Color4f(value) * weight;
+            }
+        });
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "ATrousDenoiser[\n"
+            "  iterations = %i,\n"
+            "  sigmaLuminance = %f,\n"
+            "  sigmaNormal = %f,\n"
+            "  sigmaAlbedo = %f\n"
+            "]",
+            m_iterations,
+            m_sigmaLuminance,
+            m_sigmaNormal,
+            m_sigmaAlbedo
+        );
+    }
+
+protected:
+    static size_t index(const Vector2i &size, int x, int y) {
+        return (size_t) y * (size_t) size.x() + (size_t) x;
+    }
+
+    /// Similarity of two shading normals (pixels without a surface only match each other)
+    float normalWeight(const Vector3f &n1, const Vector3f &n2) const {
+        bool empty1 = n1.isZero(), empty2 = n2.isZero();
+        if (empty1 || empty2)
+            return empty1 == empty2 ? 1.0f : 0.0f;
+        return std::pow(std::max(0.0f, n1.dot(n2)), m_sigmaNormal);
+    }
+
+    /// Run a function for all rows of the image in parallel
+    template <typename Func> static void parallelRows(int height, const Func &func) {
+        tbb::parallel_for(tbb::blocked_range<int>(0, height),
+            [&](const tbb::blocked_range<int> &range) {
+                for (int y = range.begin(); y < range.end(); ++y)
+                    func(y);
+            });
+    }
+
+    int m_iterations;
+    float m_sigmaLuminance;
+    float m_sigmaNormal;
+    float m_sigmaAlbedo;
+};
+
+NORI_REGISTER_CLASS(ATrousDenoiser, "atrous");
+NORI_NAMESPACE_END
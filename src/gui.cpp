@@ -6,10 +6,12 @@
 
 #include <nori/gui.h>
 #include <nori/block.h>
+#include <nori/timer.h>
 #include <nanogui/shader.h>
 #include <nanogui/label.h>
 #include <nanogui/slider.h>
 #include <nanogui/layout.h>
+#include <nanogui/window.h>
 #include <nanogui/renderpass.h>
 #include <nanogui/texture.h>
 
@@ -41,6 +43,16 @@ NoriScreen::NoriScreen(const ImageBlock &block)
     panel->set_position(
         nanogui::Vector2i((m_size.x() - panel->size().x()) / 2, block.getSize().y()));
 
+    /* Performance overlay in the top left corner of the image */
+    m_statsPanel = new Window(this, "Statistics");
+    m_statsPanel->set_layout(new BoxLayout(Orientation::Vertical, Alignment::Minimum, 6, 2));
+    m_statsPanel->set_position(nanogui::Vector2i(10, 10));
+    m_samplesLabel = new Label(m_statsPanel, "", "sans", 14);
+    m_raysLabel = new Label(m_statsPanel, "", "sans", 14);
+    m_progressLabel = new Label(m_statsPanel, "Waiting for the render to start", "sans", 14);
+    m_lastStats = Statistics::snapshot();
+    perform_layout();
+
     /* Simple gamma tonemapper as a GLSL shader */
 
     m_renderPass = new RenderPass({ this });
@@ -116,10 +128,65 @@ NoriScreen::NoriScreen(const ImageBlock &block)
     set_visible(true);
 }
 
+void NoriScreen::updateStatistics() {
+    /* Compute the rates over the last refresh interval, which is
+       long enough for the numbers to remain legible */
+    Statistics::Snapshot stats = Statistics::snapshot();
+    if (stats.time < m_lastStats.time) /* A new render was started */
+        m_lastStats = Statistics::Snapshot{ 0, { }, { }, 0, 0 };
+    double interval = stats.time - m_lastStats.time;
+    if (interval < 500)
+        return;
+
+    auto rate = [&](Statistics::ECounter counter) {
+        return (stats.totals[counter] - m_lastStats.totals[counter]) * 1000.0 / interval;
+    };
+    m_samplesLabel->set_caption(tfm::format("%.2f Msamples/s", rate(Statistics::ESamples) * 1e-6));
+    m_raysLabel->set_caption(tfm::format("%.2f Mrays/s (%.2f closest hit, %.2f shadow)",
+        (rate(Statistics::EClosestHitRays) + rate(Statistics::EShadowRays)) * 1e-6,
+        rate(Statistics::EClosestHitRays) * 1e-6, rate(Statistics::EShadowRays) * 1e-6));
+
+    std::string progress = "Waiting for the render to start";
+    if (stats.workTotal > 0) {
+        double fraction = std::min(1.0, (double) stats.workDone / stats.workTotal);
+        progress = tfm::format("%.1f%% done", fraction * 100);
+        if (fraction > 0 && fraction < 1)
+            progress += tfm::format(", %s remaining", timeString(stats.time * (1 - fraction) / fraction));
+    }
+    m_progressLabel->set_caption(progress);
+
+    /* Fraction of the wall-clock time that each thread spent rendering */
+    while (m_threadLabels.size() < stats.busyTime.size())
+        m_threadLabels.push_back(new nanogui::Label(m_statsPanel, "", "sans", 14));
+    for (size_t i = 0; i < stats.busyTime.size(); ++i) {
+        uint64_t last = i < m_lastStats.busyTime.size() ? m_lastStats.busyTime[i] : 0;
+        double utilization = (stats.busyTime[i] - last) * 1e-6 / interval;
+        m_threadLabels[i]->set_caption(tfm::format("Thread %i: %.0f%% busy",
+            i + 1, std::min(1.0, utilization) * 100));
+    }
+
+    m_lastStats = stats;
+
+    /* Fit the overlay to the new captions */
+    perform_layout();
+}
 
 void NoriScreen::draw_contents() {
-    // Reload the partially rendered image onto the GPU
-    m_block.lock();
+    updateStatistics();
+
+    // Upload the regions of the partially rendered image that changed since
+    // the last frame. They are read from the snapshot of the block, which the
+    // render threads update under the row locks: a tile that is modified while
+    // it is copied is marked again and uploaded in the next frame
+    for (const BoundingBox2i &tile : m_block.fetchDirtyTiles()) {
+        Vector2i extents = tile.getExtents();
+        m_staging.resize((size_t) extents.x() * extents.y());
+        m_block.readSnapshot(tile, m_staging.data());
+        m_texture->upload_sub_region((const uint8_t *) m_staging.data(),
+                                     nanogui::Vector2i(tile.min.x(), tile.min.y()),
+                                     nanogui::Vector2i(extents.x(), extents.y()));
+    }
+
     const Vector2i &size = m_block.getSize();
     m_shader->set_uniform("scale", m_scale);
     m_renderPass->resize(framebuffer_size());
@@ -127,14 +194,12 @@ void NoriScreen::draw_contents() {
     m_renderPass->set_viewport(nanogui::Vector2i(0, 0),
                                nanogui::Vector2i(m_pixel_ratio * size[0],
                                                  m_pixel_ratio * size[1]));
-    m_texture->upload((uint8_t *) m_block.data());
     m_shader->set_texture("source", m_texture);
     m_shader->begin();
     m_shader->draw_array(nanogui::Shader::PrimitiveType::Triangle, 0, 6, true);
     m_shader->end();
     m_renderPass->set_viewport(nanogui::Vector2i(0, 0), framebuffer_size());
     m_renderPass->end();
-    m_block.unlock();
 }
 
 NORI_NAMESPACE_END
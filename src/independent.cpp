@@ -29,19 +29,25 @@ public:
     std::unique_ptr<Sampler> clone() const {
         std::unique_ptr<Independent> cloned(new Independent());
         cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
         cloned->m_random = m_random;
+        cloned->m_pixel = m_pixel;
+        cloned->m_sampleIndex = m_sampleIndex;
         return std::move(cloned);
     }
 
-    void prepare(const ImageBlock &block) {
-        m_random.seed(
-            block.getOffset().x(),
-            block.getOffset().y()
-        );
+    void prepare(const ImageBlock &block) { /* No-op for this sampler */ }
+
+    void generate(const Point2i &pixel) {
+        m_pixel = pixel;
+        m_sampleIndex = m_sampleOffset;
+        seed();
     }
 
-    void generate() { /* No-op for this sampler */ }
-    void advance()  { /* No-op for this sampler */ }
+    void advance() {
+        m_sampleIndex++;
+        seed();
+    }
 
     float next1D() {
         return m_random.nextFloat();
@@ -60,8 +66,19 @@ public:
 protected:
     Independent() { }
 
+    /* Use a different stream for every sample of every pixel, which makes
+       the result independent of the order in which samples are taken */
+    void seed() {
+        m_random.seed(
+            ((uint64_t) (uint32_t) m_pixel.x() << 32) | (uint32_t) m_pixel.y(),
+            m_sampleIndex
+        );
+    }
+
 private:
     pcg32 m_random;
+    Point2i m_pixel = Point2i(0);
+    uint64_t m_sampleIndex = 0;
 };
 
 NORI_REGISTER_CLASS(Independent, "independent");
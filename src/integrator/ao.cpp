@@ -17,7 +17,7 @@ class AOIntegrator : public Integrator {
         Vector3f dir_norm = dir.normalized();
         float cosTheta = std::max(0.f, dir_norm.dot(shFrame.n));
         Color3f c = cosTheta * INV_PI;
-        return !scene->rayIntersect(Ray3f(its.p, dir_norm)) ? c : Color3f(0.0f);
+        return !scene->rayIntersect(its.spawnRay(dir_norm)) ? c : Color3f(0.0f);
     }
 
     std::string toString() const {
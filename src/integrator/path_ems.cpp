@@ -49,7 +49,7 @@ class EmitterSampling : public Integrator {
                 auto f = bsdf->eval(BSDFQueryRecord(its.shFrame.toLocal(wis), its.shFrame.toLocal(wos), ESolidAngle));
                 float G = abs(wos.dot(its.shFrame.n)) * abs(eRec.n.dot(-wos)) / (eRec.p - its.p).squaredNorm();
                 auto V = Color3f(1.f);
-                if(scene->rayIntersect(Ray3f(its.p, wos, Epsilon, (eRec.p - its.p).norm() - Epsilon))) V = Color3f(0.f);
+                if(scene->rayIntersect(its.spawnRayTo(eRec.p))) V = Color3f(0.f);
                 L += ((V * f * G * Le) /  (eRec.pdf * lightPdf)) * beta;
             }
             
@@ -63,7 +63,7 @@ class EmitterSampling : public Integrator {
             BSDFQueryRecord bRec(its.shFrame.toLocal(wi));
             beta *= bsdf->sample(bRec, sampler->next2D());
             eta *= bRec.eta;
-            ray_ =  Ray3f(its.p, its.shFrame.toWorld(bRec.wo)); 
+            ray_ = its.spawnRay(its.shFrame.toWorld(bRec.wo));
             bounces++;
         }
         return L;
@@ -32,7 +32,7 @@ class MaterialSampling : public Integrator {
             BSDFQueryRecord bRec(its.shFrame.toLocal(wi));
             beta *= bsdf->sample(bRec, sampler->next2D());
             eta *= bRec.eta;
-            ray_ =  Ray3f(its.p, its.shFrame.toWorld(bRec.wo)); //using the Ray3f constructor automatically update the inverse direction
+            ray_ = its.spawnRay(its.shFrame.toWorld(bRec.wo));
             // ray_.o = its.p;
             // ray_.d = its.shFrame.toWorld(bRec.wo);
             if(bounces >= 3){
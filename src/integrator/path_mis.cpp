@@ -3,6 +3,7 @@
 #include <nori/warp.h>
 #include <nori/emitter.h>
 #include <nori/bsdf.h>
+#include <nori/aov.h>
 
 NORI_NAMESPACE_BEGIN
 class MISPathTracer : public Integrator {
@@ -11,6 +12,20 @@ class MISPathTracer : public Integrator {
     }
 
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        return trace(scene, sampler, ray, nullptr);
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray, AOVRecord &aov) const {
+        aov.clear();
+        return trace(scene, sampler, ray, &aov);
+    }
+
+    std::string toString() const {
+        return "MISPathTracer[]";   
+    }
+    protected:
+    /// Trace a path, recording the output variables at its first vertex (if \c aov is given)
+    Color3f trace(const Scene *scene, Sampler *sampler, const Ray3f &ray, AOVRecord *aov) const {
         Intersection its;
         Ray3f ray_ = ray; //Place holder
         int bounces = 0;
@@ -28,14 +43,17 @@ class MISPathTracer : public Integrator {
             wi = -ray_.d.normalized();
             if (!scene->rayIntersect(ray_, its))
                 break;
+            if (bounces == 0 && aov)
+                aov->setSurface(its);
             
             if (its.mesh->isEmitter() && its.shFrame.n.dot(wi) > 0){
-                EmitterQueryRecord eRec_(its.p, its.shFrame.n, 1.f / its.mesh->surfaceArea());
+                EmitterQueryRecord eRec_(its.p, its.shFrame.n, 0.f);
                 if((bounces == 0 || specularBounce)) {
                     L += its.mesh->getEmitter()->eval(eRec_, -wi) * beta; // don't account for mis term since we don't do 
                                                                         // light sampling at vertex or specular bsdf
                 }
                 else {
+                    eRec_.pdf = its.mesh->pdf(prevIts.p, eRec_);
                     eRec_.pdf *= ((eRec_.p - prevIts.p).squaredNorm() / eRec_.n.dot(wi) ); //area -> solid angle
                     //auto lpdf = eRec_.pdf * scene->emitterPDF(its.mesh);
                     lightPdf = (scene->getLights().size() != 0) ? 1.f / scene->getLights().size() : 1.f;
@@ -62,7 +80,7 @@ class MISPathTracer : public Integrator {
                 auto bRec_ = BSDFQueryRecord(its.shFrame.toLocal(wis), its.shFrame.toLocal(wos), ESolidAngle);
                 auto f = bsdf->eval(bRec_, its);
                 auto V = Color3f(1.f);
-                if(scene->rayIntersect(Ray3f(its.p, wos, Epsilon, (eRec.p - its.p).norm() - Epsilon))) V = Color3f(0.f);
+                if(scene->rayIntersect(its.spawnRayTo(eRec.p))) V = Color3f(0.f);
                 auto bpdf = bsdf->pdf(bRec_, its);  
         
                 if (eRec.n.dot(-wos) > 0.f){
@@ -86,16 +104,11 @@ class MISPathTracer : public Integrator {
             eta *= bRec.eta * bRec.eta;
             prev_bpdf = bsdf->pdf(bRec, its);
             prevIts = its;
-            ray_ =  Ray3f(its.p, its.shFrame.toWorld(bRec.wo)); 
+            ray_ = its.spawnRay(its.shFrame.toWorld(bRec.wo));
             bounces++;
         }
         return L;
      }
-
-    std::string toString() const {
-        return "MISPathTracer[]";   
-    }
-    protected:
 };
 
 NORI_REGISTER_CLASS(MISPathTracer, "path_mis");
@@ -0,0 +1,332 @@
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/block.h>
+#include <nori/sampler.h>
+#include <nori/emitter.h>
+#include <nori/bsdf.h>
+#include <nori/aov.h>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Wavefront path tracer
+ *
+ * Computes the same estimator as \c path_mis (BSDF sampling and emitter
+ * sampling combined using the balance heuristic), but instead of tracing
+ * one path at a time, the samples of an image block are processed in
+ * batches of \c wavefrontSize paths that move through a sequence of stages:
+ *
+ *  1. generate camera rays
+ *  2. find the closest intersections of all active paths
+ *  3. shade the hits, grouped by BSDF: add emission, sample an emitter
+ *     (queueing a shadow ray) and sample the BSDF
+ *  4. trace the queued shadow rays
+ *  5. Russian roulette and compaction of the active path list
+ *
+ * Path state is stored as a structure of arrays. Every stage runs a tight
+ * loop over the batch, which keeps the working set of each stage small and
+ * is the basis for batched traversal. Every path draws its camera sample
+ * and its bounces from its own copy of the sampler, which is positioned at
+ * the pixel and sample index of the path, so that a stratifying sampler
+ * also stratifies the bounces.
+ */
+class WavefrontPathTracer : public Integrator {
+public:
+    WavefrontPathTracer(const PropertyList &props) {
+        m_maxDepth = props.getInteger("maxDepth", 50);
+        m_wavefrontSize = props.getInteger("wavefrontSize", 4096);
+        if (m_wavefrontSize <= 0)
+            throw NoriException("WavefrontPathTracer: 'wavefrontSize' must be positive!");
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        /* Trace a wavefront that consists of a single path */
+        PathQueue queue;
+        queue.resize(1);
+        queue.start(0, ray, Color3f(1.f), Point2f(0.f), sampler);
+        trace(scene, queue);
+        return queue.L[0];
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray, AOVRecord &aov) const {
+        PathQueue queue;
+        queue.resize(1);
+        queue.start(0, ray, Color3f(1.f), Point2f(0.f), sampler);
+        trace(scene, queue);
+        aov = queue.aov[0];
+        return queue.L[0];
+    }
+
+    bool renderBlock(const Scene *scene, Sampler *sampler,
+                     ImageBlock &block, uint32_t sampleCount) const {
+        const Camera *camera = scene->getCamera();
+        Point2i offset = block.getOffset();
+        Vector2i size  = block.getSize();
+        uint64_t total = (uint64_t) size.x() * size.y() * sampleCount;
+        size_t sampleOffset = sampler->getSampleOffset();
+
+        PathQueue queue;
+        std::vector<std::unique_ptr<Sampler>> samplers;
+        for (uint64_t first = 0; first < total; first += m_wavefrontSize) {
+            uint32_t count = (uint32_t) std::min((uint64_t) m_wavefrontSize, total - first);
+            queue.resize(count);
+            while (samplers.size() < count)
+                samplers.push_back(sampler->clone());
+
+            /* Stage 1: generate camera rays (in the same order as the
+               per-sample renderer: all samples of a pixel in sequence) */
+            for (uint32_t i = 0; i < count; ++i) {
+                uint32_t index = (uint32_t) ((first + i) / sampleCount);
+                Point2i pixel(index % size.x() + offset.x(), index / size.x() + offset.y());
+
+                /* Position the sampler of the path at its pixel sample */
+                Sampler *sampler = samplers[i].get();
+                sampler->setSampleOffset(sampleOffset + (first + i) % sampleCount);
+                sampler->generate(pixel);
+
+                Point2f pixelSample;
+                float filterWeight = 1.0f;
+                if (block.isFilterImportanceSampled())
+                    pixelSample = Point2f(pixel.x() + 0.5f, pixel.y() + 0.5f) +
+                        block.sampleFilter(sampler->next2D(), filterWeight);
+                else
+                    pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + sampler->next2D();
+                Point2f apertureSample = sampler->next2D();
+
+                Ray3f ray;
+                Color3f weight = camera->sampleRay(ray, pixelSample, apertureSample);
+                if (scene->hasMotion())
+                    ray.time = camera->sampleTime(sampler->next1D());
+
+                queue.start(i, ray, weight, pixelSample, sampler);
+                queue.aov[i].firstSample = sampleOffset + (first + i) % sampleCount == 0;
+                queue.pixel[i] = pixel;
+                queue.filterWeight[i] = filterWeight;
+            }
+
+            trace(scene, queue);
+
+            bool hasAOVs = !block.getAOVs().empty();
+            if (block.isFilterImportanceSampled()) {
+                for (uint32_t i = 0; i < count; ++i)
+                    block.put(queue.pixel[i], queue.L[i], queue.filterWeight[i],
+                              hasAOVs ? &queue.aov[i] : nullptr);
+            } else if (hasAOVs) {
+                for (uint32_t i = 0; i < count; ++i)
+                    block.put(queue.pixelSample[i], queue.L[i], &queue.aov[i]);
+            } else {
+                block.put(queue.pixelSample.data(), queue.L.data(), count);
+            }
+        }
+
+        return true;
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "WavefrontPathTracer[\n"
+            "  maxDepth = %i,\n"
+            "  wavefrontSize = %i\n"
+            "]",
+            m_maxDepth,
+            m_wavefrontSize
+        );
+    }
+
+protected:
+    /// Path state of a wavefront (structure of arrays)
+    struct PathQueue {
+        /* Per-path state */
+        std::vector<Ray3f> ray;              ///< Ray of the current bounce
+        std::vector<Intersection> its;       ///< Closest hit of the current bounce
+        std::vector<Color3f> beta;           ///< Path throughput
+        std::vector<Color3f> L;              ///< Accumulated radiance
+        std::vector<Color3f> bsdfWeight;     ///< Weight of the sampled BSDF direction
+        std::vector<Point2f> pixelSample;    ///< Image plane position
+        std::vector<Point2i> pixel;          ///< Pixel of the sample
+        std::vector<float> filterWeight;     ///< Sign of the filter (filter importance sampling)
+        std::vector<Point3f> prevP;          ///< Previous path vertex
+        std::vector<float> prevPdf;          ///< BSDF pdf of the sampled direction
+        std::vector<float> eta;              ///< Accumulated squared relative IOR
+        std::vector<float> etaScale;         ///< Squared relative IOR of the sampled direction
+        std::vector<uint32_t> bounces;       ///< Number of bounces
+        std::vector<uint8_t> specular;       ///< Was the last bounce specular?
+        std::vector<Sampler *> sampler;      ///< Random numbers for the bounces
+        std::vector<AOVRecord> aov;          ///< Output variables of the first hit
+
+        /// Indices of the paths that are still alive
+        std::vector<uint32_t> active;
+
+        /* Shadow ray queue */
+        std::vector<Ray3f> shadowRay;
+        std::vector<Color3f> shadowL;
+        std::vector<uint32_t> shadowPath;
+
+        void resize(uint32_t n) {
+            ray.resize(n); its.resize(n); beta.resize(n); L.resize(n);
+            bsdfWeight.resize(n); pixelSample.resize(n); pixel.resize(n);
+            filterWeight.resize(n); prevP.resize(n);
+            prevPdf.resize(n); eta.resize(n); etaScale.resize(n);
+            bounces.resize(n); specular.resize(n); sampler.resize(n); aov.resize(n);
+            active.resize(n);
+            for (uint32_t i = 0; i < n; ++i)
+                active[i] = i;
+        }
+
+        /// Initialize a path starting with the given camera ray
+        void start(uint32_t i, const Ray3f &r, const Color3f &weight,
+                   const Point2f &pos, Sampler *sampler) {
+            ray[i] = r;
+            beta[i] = weight;
+            L[i] = Color3f(0.f);
+            pixelSample[i] = pos;
+            prevPdf[i] = 1.f;
+            eta[i] = 1.f;
+            bounces[i] = 0;
+            specular[i] = 0;
+            aov[i].clear();
+            this->sampler[i] = sampler;
+        }
+    };
+
+    /// Run stages 2-5 until all paths of the wavefront have terminated
+    void trace(const Scene *scene, PathQueue &queue) const {
+        while (!queue.active.empty()) {
+            intersect(scene, queue);
+            shade(scene, queue);
+            traceShadowRays(scene, queue);
+            roulette(queue);
+        }
+    }
+
+    /// Stage 2: closest-hit queries, drops paths that leave the scene
+    void intersect(const Scene *scene, PathQueue &queue) const {
+        size_t alive = 0;
+        for (uint32_t i : queue.active) {
+            if (queue.bounces[i] >= (uint32_t) m_maxDepth)
+                continue;
+            if (!scene->rayIntersect(queue.ray[i], queue.its[i]))
+                continue;
+            /* Record the output variables at the first visible surface */
+            if (queue.bounces[i] == 0)
+                queue.aov[i].setSurface(queue.its[i]);
+            queue.active[alive++] = i;
+        }
+        queue.active.resize(alive);
+    }
+
+    /// Stage 3: emission, emitter sampling and BSDF sampling grouped by BSDF
+    void shade(const Scene *scene, PathQueue &queue) const {
+        std::stable_sort(queue.active.begin(), queue.active.end(),
+            [&](uint32_t a, uint32_t b) {
+                return queue.its[a].mesh->getBSDF() < queue.its[b].mesh->getBSDF();
+            });
+
+        const std::vector<Mesh *> &lights = scene->getLights();
+        float lightPdf = lights.empty() ? 0.f : 1.f / lights.size();
+
+        for (size_t start = 0, end; start < queue.active.size(); start = end) {
+            /* Find the range of paths that hit the same BSDF */
+            const BSDF *bsdf = queue.its[queue.active[start]].mesh->getBSDF();
+            for (end = start + 1; end < queue.active.size() &&
+                 queue.its[queue.active[end]].mesh->getBSDF() == bsdf; ++end)
+                ;
+            bool diffuse = bsdf->isDiffuse();
+
+            for (size_t k = start; k < end; ++k) {
+                uint32_t i = queue.active[k];
+                const Intersection &its = queue.its[i];
+                Vector3f wi = -queue.ray[i].d.normalized();
+                Sampler *sampler = queue.sampler[i];
+
+                /* Emission, weighted against emitter sampling at the previous vertex */
+                if (its.mesh->isEmitter() && its.shFrame.n.dot(wi) > 0) {
+                    EmitterQueryRecord eRec(its.p, its.shFrame.n, 0.f);
+                    Color3f Le = its.mesh->getEmitter()->eval(eRec, -wi);
+                    if (queue.bounces[i] == 0 || queue.specular[i]) {
+                        queue.L[i] += Le * queue.beta[i];
+                    } else {
+                        float lpdf = its.mesh->pdf(queue.prevP[i], eRec) * lightPdf *
+                            (its.p - queue.prevP[i]).squaredNorm() / its.shFrame.n.dot(wi);
+                        float prevPdf = queue.prevPdf[i];
+                        float w = (prevPdf + lpdf != 0.f) ? prevPdf / (prevPdf + lpdf) : 0.f;
+                        queue.L[i] += w * Le * queue.beta[i];
+                    }
+                }
+
+                /* Emitter sampling: queue a shadow ray */
+                queue.specular[i] = !diffuse;
+                if (diffuse && !lights.empty()) {
+                    int index = std::min((int) (sampler->next1D() * lights.size()), (int) lights.size() - 1);
+                    const Emitter *light = lights[index]->getEmitter();
+                    EmitterQueryRecord eRec;
+                    Color3f Le = light->sample(eRec, its.p, sampler);
+                    Vector3f wo = (eRec.p - its.p).normalized();
+                    BSDFQueryRecord bRec(its.shFrame.toLocal(wi), its.shFrame.toLocal(wo), ESolidAngle);
+
+                    if (eRec.n.dot(-wo) > 0.f) {
+                        Color3f f = bsdf->eval(bRec, its);
+                        float bpdf = bsdf->pdf(bRec, its);
+                        float lpdf = eRec.pdf * lightPdf * (eRec.p - its.p).squaredNorm() / eRec.n.dot(-wo);
+                        float w = (lpdf + bpdf != 0.f) ? lpdf / (lpdf + bpdf) : 0.f;
+                        Color3f contrib = w * f * Le * its.shFrame.n.dot(wo) / lpdf * queue.beta[i];
+                        if (!contrib.isZero()) {
+                            queue.shadowRay.push_back(its.spawnRayTo(eRec.p));
+                            queue.shadowL.push_back(contrib);
+                            queue.shadowPath.push_back(i);
+                        }
+                    }
+                }
+
+                /* BSDF sampling: compute the next ray */
+                BSDFQueryRecord bRec(its.shFrame.toLocal(wi));
+                queue.bsdfWeight[i] = bsdf->sample(bRec, its, sampler->next2D());
+                queue.etaScale[i] = bRec.eta * bRec.eta;
+                queue.prevPdf[i] = bsdf->pdf(bRec, its);
+                queue.prevP[i] = its.p;
+                queue.ray[i] = its.spawnRay(its.shFrame.toWorld(bRec.wo));
+            }
+        }
+    }
+
+    /// Stage 4: occlusion queries for the queued emitter samples
+    void traceShadowRays(const Scene *scene, PathQueue &queue) const {
+        for (size_t k = 0; k < queue.shadowRay.size(); ++k) {
+            if (!scene->rayIntersect(queue.shadowRay[k]))
+                queue.L[queue.shadowPath[k]] += queue.shadowL[k];
+        }
+        queue.shadowRay.clear();
+        queue.shadowL.clear();
+        queue.shadowPath.clear();
+    }
+
+    /// Stage 5: Russian roulette, throughput update and compaction
+    void roulette(PathQueue &queue) const {
+        size_t alive = 0;
+        for (uint32_t i : queue.active) {
+            if (queue.bounces[i] >= 3) {
+                float q = std::min(queue.beta[i].maxCoeff() * queue.eta[i], 0.99f);
+                if (queue.sampler[i]->next1D() > q)
+                    continue;
+                queue.beta[i] /= q;
+            }
+
+            queue.beta[i] *= queue.bsdfWeight[i];
+            queue.eta[i] *= queue.etaScale[i];
+            queue.bounces[i]++;
+
+            if (queue.beta[i].isZero())
+                continue;
+            queue.active[alive++] = i;
+        }
+        queue.active.resize(alive);
+    }
+
+    int m_maxDepth;
+    int m_wavefrontSize;
+};
+
+NORI_REGISTER_CLASS(WavefrontPathTracer, "path_wavefront");
+NORI_NAMESPACE_END
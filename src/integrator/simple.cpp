@@ -18,7 +18,7 @@ class SimpleIntegrator : public Integrator {
         Vector3f dir_norm = dir.normalized();
         float cosTheta = std::max(0.f, dir_norm.dot(its.shFrame.n));
         Color3f c = (phi * INV_PI * INV_PI / 4) * (cosTheta /dir.squaredNorm()); //the dir here must not been normalized
-        return !scene->rayIntersect(Ray3f(its.p, dir_norm)) ? c : Color3f(0.0f);
+        return !scene->rayIntersect(its.spawnRay(dir_norm)) ? c : Color3f(0.0f);
     }
 
     std::string toString() const {
@@ -38,7 +38,7 @@ class WhittedIntegrator : public Integrator {
 
             float G = abs(wo.dot(its.shFrame.n)) * abs(eRec.n.dot(-wo)) / (eRec.p - its.p).squaredNorm();
             auto V = Color3f(1.f);
-            if(scene->rayIntersect(Ray3f(its.p, wo, Epsilon, (eRec.p - its.p).norm() - Epsilon))) V = Color3f(0.f);
+            if(scene->rayIntersect(its.spawnRayTo(eRec.p))) V = Color3f(0.f);
             //i don't know why but if not add epsilon everything fuk up
             L += (V * f * G * Le) /  (eRec.pdf * lightPdf);
 
@@ -49,7 +49,7 @@ class WhittedIntegrator : public Integrator {
             BSDFQueryRecord bRec(its.shFrame.toLocal(wi));
             auto c = bsdf->sample(bRec, sampler->next2D());
             if (sampler->next1D() < 0.95){
-                return c * 1.f/0.95 *  Li(scene, sampler, Ray3f(its.p, its.toWorld(bRec.wo.normalized())));
+                return c * 1.f/0.95 *  Li(scene, sampler, its.spawnRay(its.toWorld(bRec.wo.normalized())));
             }
             else return Color3f(0.f);
         };
@@ -8,7 +8,7 @@ class AreaLight : public Emitter {
     }
 
     Color3f sample(EmitterQueryRecord &eRec, const Point3f p, Sampler* sampler) const {
-        eRec = mesh->sample(sampler);
+        eRec = mesh->sample(p, sampler);
         Vector3f wi = (eRec.p - p).normalized();
         return eval(eRec, wi);
     }
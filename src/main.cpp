@@ -12,19 +12,83 @@
 #include <nori/bitmap.h>
 #include <nori/sampler.h>
 #include <nori/integrator.h>
+#include <nori/denoiser.h>
+#include <nori/stream.h>
+#include <nori/checkpoint.h>
+#include <nori/camerapath.h>
+#include <nori/stats.h>
 #include <nori/gui.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
 #include <tbb/task_scheduler_init.h>
 #include <filesystem/resolver.h>
+#include <ImfThreading.h>
 #include <thread>
+#include <functional>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 
 using namespace nori;
 
 static int threadCount = -1;
 static bool gui = true;
+static bool progressive = false;       ///< Render in several passes?
+static int passSampleCount = 1;        ///< Samples per pixel and pass (progressive mode)
+static int targetSampleCount = 0;      ///< Stop after this many samples per pixel (0: use the sampler's count)
+static double timeLimit = 0;           ///< Wall-clock budget in seconds (0: unlimited)
+static float adaptiveThreshold = 0;    ///< Relative error below which pixels stop (0: no adaptive sampling)
+static int adaptiveMinSamples = 8;     ///< Samples per pixel taken before the error estimate is trusted
+static int blockSize = NORI_BLOCK_SIZE; ///< Maximum size of the blocks rendered by the threads
+static BlockGenerator::EBlockOrder blockOrder = BlockGenerator::ESpiral;
+static Point2i cropOffset(0, 0);       ///< Crop window (overrides the camera's if \c cropSize is nonzero)
+static Vector2i cropSize(0, 0);
+static std::string compositeName;      ///< Image into which the crop window is composited
+static bool streamOutput = false;      ///< Write finished tiles directly into a tiled EXR file?
+static double checkpointInterval = 0;  ///< Seconds between checkpoints (0: no checkpoints)
+static bool resume = false;            ///< Continue from the last checkpoint?
+static bool server = false;            ///< Keep the scene loaded and render requests from stdin?
+static std::string cameraPathName;     ///< Render one frame per camera transformation in this file
+static int shardIndex = 0;             ///< Only render the blocks of this shard ..
+static int shardCount = 1;             ///< .. out of this many
+static Bitmap::ECompression exrCompression = Bitmap::EZIP; ///< Compression of the written OpenEXR files
+static std::vector<std::string> halfLayers; ///< Layers written with 16 bit precision ("rgb", AOV names or "all")
+static bool tileStats = false;         ///< Write the render time and ray counts of each block?
 
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) {
+/**
+ * \brief Should the given output channel be written with 16 bit precision?
+ *
+ * Channels are selected by their layer: "rgb" for the color, and the
+ * names of the output variables (e.g. "albedo" for albedo.R/G/B).
+ * "all" excludes the object IDs, which half floats only represent
+ * exactly up to 2048.
+ */
+static bool isHalfChannel(const std::string &channel) {
+    std::string layer;
+    if (channel == "R" || channel == "G" || channel == "B")
+        layer = "rgb";
+    else if (channel == "A")
+        layer = "alpha";
+    else
+        layer = channel.substr(0, channel.find('.'));
+    for (const std::string &name : halfLayers)
+        if ((name == "all" && layer != "id") || name == layer)
+            return true;
+    return false;
+}
+
+/**
+ * \brief Render \c sampleCount samples in every pixel of the block
+ *
+ * When a moment buffer is given, the luminance of each sample is recorded
+ * there, and pixels whose relative error already dropped below the
+ * adaptive sampling threshold are skipped.
+ *
+ * \return The number of pixels that received samples
+ */
+static uint32_t renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block,
+                            uint32_t sampleCount, MomentBuffer *moments = nullptr) {
     const Camera *camera = scene->getCamera();
     const Integrator *integrator = scene->getIntegrator();
 
@@ -34,42 +98,324 @@ static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block)
     /* Clear the block contents */
     block.clear();
 
+    /* Let integrators that batch their paths process the whole block */
+    bool hasAOVs = !block.getAOVs().empty();
+    if (!moments && integrator->renderBlock(scene, sampler, block, sampleCount)) {
+        Statistics::add(Statistics::ESamples, (uint64_t) size.x() * size.y() * sampleCount);
+        return (uint32_t) (size.x() * size.y());
+    }
+
+    uint32_t activePixels = 0;
+
+    /* Samples of the current pixel, splatted together in one batch */
+    std::vector<Point2f> positions;
+    std::vector<Color3f> values;
+    positions.reserve(sampleCount);
+    values.reserve(sampleCount);
+
     /* For each pixel and pixel sample sample */
     for (int y=0; y<size.y(); ++y) {
         for (int x=0; x<size.x(); ++x) {
-            for (uint32_t i=0; i<sampler->getSampleCount(); ++i) {
-                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
+            Point2i pixel(x + offset.x(), y + offset.y());
+
+            /* Skip pixels that have converged (adaptive sampling) */
+            if (moments && moments->getSampleCount(pixel) >= (uint32_t) adaptiveMinSamples &&
+                moments->getRelativeError(pixel) < adaptiveThreshold)
+                continue;
+            activePixels++;
+
+            positions.clear();
+            values.clear();
+            sampler->generate(pixel);
+            for (uint32_t i=0; i<sampleCount; ++i) {
+                Point2f pixelSample;
+                float filterWeight = 1.0f;
+                if (block.isFilterImportanceSampled())
+                    pixelSample = Point2f(pixel.x() + 0.5f, pixel.y() + 0.5f) +
+                        block.sampleFilter(sampler->next2D(), filterWeight);
+                else
+                    pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + sampler->next2D();
                 Point2f apertureSample = sampler->next2D();
 
                 /* Sample a ray from the camera */
                 Ray3f ray;
                 Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
 
-                /* Compute the incident radiance */
-                value *= integrator->Li(scene, sampler, ray);
+                /* Sample a time within the shutter interval if anything moves */
+                if (scene->hasMotion())
+                    ray.time = camera->sampleTime(sampler->next1D());
+
+                /* Compute the incident radiance (and the output variables) */
+                AOVRecord aov;
+                if (hasAOVs)
+                    value *= integrator->Li(scene, sampler, ray, aov);
+                else
+                    value *= integrator->Li(scene, sampler, ray);
+                aov.firstSample = sampler->getSampleOffset() + i == 0;
 
                 /* Store in the image block */
-                block.put(pixelSample, value);
+                if (block.isFilterImportanceSampled())
+                    block.put(pixel, value, filterWeight, hasAOVs ? &aov : nullptr);
+                else if (hasAOVs)
+                    block.put(pixelSample, value, &aov);
+                else {
+                    positions.push_back(pixelSample);
+                    values.push_back(value);
+                }
+
+                if (moments && value.isValid())
+                    moments->put(pixel, value.getLuminance());
+
+                sampler->advance();
             }
+
+            if (!positions.empty())
+                block.put(positions.data(), values.data(), positions.size());
         }
     }
+
+    Statistics::add(Statistics::ESamples, (uint64_t) activePixels * sampleCount);
+    return activePixels;
 }
 
-static void render(Scene *scene, const std::string &filename) {
+/**
+ * \brief Render \c sampleCount samples per pixel and pass the finished blocks to \c merge
+ *
+ * The samples are numbered starting at \c sampleOffset. When a time limit
+ * is set and the deadline passes during the pass, the remaining blocks
+ * are skipped. Since every pixel is normalized by its accumulated filter
+ * weight, the result remains correct (if slightly noisier in those blocks).
+ *
+ * With adaptive sampling, \c activePixels is set to the number of pixels
+ * that had not converged yet and therefore received samples. The cost of
+ * each block is added to \c tiles if given.
+ *
+ * \return \c false if the pass was cut short by the time limit
+ */
+static bool renderPass(const Scene *scene, const std::function<void(ImageBlock &)> &merge,
+                       size_t sampleOffset, uint32_t sampleCount, const Timer &timer,
+                       MomentBuffer *moments = nullptr, uint64_t *activePixels = nullptr,
+                       TileStatistics *tiles = nullptr) {
+    const Camera *camera = scene->getCamera();
+
+    /* Create a block generator (i.e. a work scheduler) for the crop window.
+       When streaming, the blocks must coincide with the tiles of the file,
+       and shards must agree on the block sequence */
+    BlockGenerator blockGenerator(cropSize, blockSize, blockOrder,
+                                  streamOutput || shardCount > 1 ? 0 : -1, cropOffset);
+    if (shardCount > 1)
+        blockGenerator.shard(shardIndex, shardCount);
+    std::atomic<bool> timeout(false);
+    std::atomic<uint64_t> active(0);
+
+    tbb::blocked_range<int> range(0, blockGenerator.getBlockCount());
+
+    auto map = [&](const tbb::blocked_range<int> &range) {
+        /* Allocate memory for a small image block to be rendered
+           by the current thread */
+        ImageBlock block(Vector2i(blockSize),
+            camera->getReconstructionFilter(), camera->getAOVs());
+
+        /* Create a clone of the sampler for the current thread */
+        std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+        sampler->setSampleOffset(sampleOffset);
+
+        for (int i=range.begin(); i<range.end(); ++i) {
+            /* Stop handing out work once the time budget is exhausted */
+            if (timeLimit > 0 && (timeout || timer.elapsed() > timeLimit * 1000)) {
+                timeout = true;
+                break;
+            }
+
+            /* Request an image block from the block generator */
+            blockGenerator.next(block);
+
+            /* Inform the sampler about the block to be rendered */
+            sampler->prepare(block);
+
+            /* Render all contained pixels */
+            auto start = std::chrono::steady_clock::now();
+            uint64_t samples = Statistics::get(Statistics::ESamples),
+                     closestHitRays = Statistics::get(Statistics::EClosestHitRays),
+                     shadowRays = Statistics::get(Statistics::EShadowRays);
+            uint32_t blockActive = renderBlock(scene, sampler.get(), block, sampleCount, moments);
+            active += blockActive;
+            if (tiles)
+                tiles->put(block.getOffset(), block.getSize(),
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+                    Statistics::get(Statistics::ESamples) - samples,
+                    Statistics::get(Statistics::EClosestHitRays) - closestHitRays,
+                    Statistics::get(Statistics::EShadowRays) - shadowRays);
+
+            /* The image block has been processed. Now add it to
+               the "big" block that represents the entire image */
+            merge(block);
+
+            Statistics::add(Statistics::EBusyTime, (uint64_t)
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+            Statistics::addWork((uint64_t) blockActive * sampleCount);
+        }
+    };
+
+    /// Default: parallel rendering
+    tbb::parallel_for(range, map);
+
+    /// (equivalent to the following single-threaded call)
+    // map(range);
+
+    if (activePixels)
+        *activePixels = active;
+
+    return !timeout;
+}
+
+/// Write the cost of each block as a heatmap (\c <name>_tiles.exr) and a table (\c <name>_tiles.csv)
+static void saveTileStatistics(const TileStatistics &tiles, const Vector2i &size,
+                               const std::string &outputName) {
+    std::unique_ptr<Bitmap> heatmap(tiles.toBitmap(size));
+    heatmap->saveEXR(outputName + "_tiles", exrCompression);
+    tiles.saveCSV(outputName + "_tiles.csv");
+}
+
+/**
+ * \brief Render the image in a single pass, streaming the finished tiles
+ * into a tiled OpenEXR file instead of keeping the entire image in memory
+ */
+static void renderStream(const Scene *scene, const std::string &outputName) {
+    const Camera *camera = scene->getCamera();
+    if (progressive)
+        throw NoriException("Streaming output renders in a single pass and can't be combined "
+                            "with progressive, adaptive or checkpointed rendering!");
+    if (scene->getDenoiser() || !compositeName.empty())
+        throw NoriException("Streaming output can't be combined with denoising or compositing, "
+                            "which need the entire image!");
+    if (shardCount > 1)
+        throw NoriException("Streaming output writes a normalized image and can't be combined "
+                            "with shards, which nori-merge combines from unnormalized partials!");
+
+    std::vector<std::string> halfChannels;
+    for (const char *name : { "R", "G", "B" })
+        if (isHalfChannel(name))
+            halfChannels.push_back(name);
+    for (const std::string &name : camera->getAOVs().getChannelNames())
+        if (isHalfChannel(name))
+            halfChannels.push_back(name);
+
+    StreamingFramebuffer stream(outputName + ".exr", camera->getOutputSize(), cropOffset, cropSize,
+        blockSize, camera->getReconstructionFilter(), camera->getAOVs(), exrCompression, halfChannels);
+
+    tbb::task_scheduler_init init(threadCount);
+    cout << "Rendering .. ";
+    cout.flush();
+    Timer timer;
+
+    std::unique_ptr<TileStatistics> tiles;
+    if (tileStats)
+        tiles.reset(new TileStatistics());
+    renderPass(scene, [&](ImageBlock &block) { stream.put(block); },
+               0, (uint32_t) scene->getSampler()->getSampleCount(), timer,
+               nullptr, nullptr, tiles.get());
+    stream.finish();
+
+    cout << "done. (took " << timer.elapsedString() << ")" << endl;
+    cout << "Peak frame buffer memory: " << stream.getPeakTileCount() << " tiles ("
+         << memString(stream.getPeakTileCount() * stream.getTileMemory()) << ")" << endl;
+
+    if (tiles)
+        saveTileStatistics(*tiles, camera->getOutputSize(), outputName);
+}
+
+/**
+ * \brief Render the scene and write the output files
+ *
+ * When \c writer is given, the files are written by a background thread
+ * stored there, so that the next image can be rendered in the meantime.
+ * That thread then reports the outcome to \c written (an error message,
+ * or an empty string on success).
+ */
+static void render(Scene *scene, const std::string &filename, std::thread *writer = nullptr,
+                   const std::function<void(const std::string &)> &written = nullptr) {
     const Camera *camera = scene->getCamera();
     Vector2i outputSize = camera->getOutputSize();
     scene->getIntegrator()->preprocess(scene);
 
-    /* Create a block generator (i.e. a work scheduler) */
-    BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+    /* Determine the region to be rendered */
+    if (cropSize.isZero()) {
+        cropOffset = camera->getCropOffset();
+        cropSize = camera->getCropSize();
+    } else if ((cropOffset.array() < 0).any() ||
+               ((cropOffset + cropSize).array() > outputSize.array()).any()) {
+        throw NoriException("The crop window %s + %s does not lie within the image of size %s!",
+            cropOffset.toString(), cropSize.toString(), outputSize.toString());
+    }
+    if (cropSize != outputSize)
+        cout << "Rendering the crop window " << cropOffset.toString() << " + "
+             << cropSize.toString() << endl;
+
+    /* Load the image to composite into before spending time on rendering */
+    std::unique_ptr<Bitmap> base;
+    if (!compositeName.empty()) {
+        base.reset(new Bitmap(compositeName));
+        if (base->cols() != outputSize.x() || base->rows() != outputSize.y())
+            throw NoriException("\"%s\" doesn't have the size of the rendered image (%s)!",
+                compositeName, outputSize.toString());
+    }
+
+    /* Determine the filename of the output bitmap */
+    std::string outputName = filename;
+    size_t lastdot = outputName.find_last_of(".");
+    if (lastdot != std::string::npos)
+        outputName.erase(lastdot, std::string::npos);
+
+    if (streamOutput) {
+        renderStream(scene, outputName);
+        return;
+    }
+
+    /* Shards store unnormalized partial images, which nori-merge combines */
+    if (shardCount > 1) {
+        if (scene->getDenoiser() || base)
+            throw NoriException("Shards can't be combined with denoising or compositing, "
+                                "which need the entire image!");
+        outputName += tfm::format("_shard%i", shardIndex);
+        cout << "Rendering shard " << shardIndex << " of " << shardCount << endl;
+    }
 
     /* Allocate memory for the entire output image and clear it */
-    ImageBlock result(outputSize, camera->getReconstructionFilter());
+    ImageBlock result(outputSize, camera->getReconstructionFilter(), camera->getAOVs());
     result.clear();
+    auto merge = [&](ImageBlock &block) { result.put(block); };
+
+    /* Per-pixel sample statistics for adaptive sampling */
+    std::unique_ptr<MomentBuffer> moments;
+    if (adaptiveThreshold > 0)
+        moments.reset(new MomentBuffer(outputSize));
+
+    /* Render time and ray counts of each block */
+    std::unique_ptr<TileStatistics> tiles;
+    if (tileStats)
+        tiles.reset(new TileStatistics());
+
+    /* Continue from the last checkpoint if requested */
+    std::unique_ptr<Checkpoint> checkpoint;
+    uint64_t resumedSampleCount = 0;
+    int resumedPasses = 0;
+    if (checkpointInterval > 0 || resume)
+        checkpoint.reset(new Checkpoint(outputName + ".checkpoint"));
+    if (resume) {
+        if (checkpoint->load(result, moments.get(), resumedSampleCount, resumedPasses))
+            cout << "Resuming from \"" << checkpoint->getFilename() << "\" ("
+                 << resumedSampleCount << " spp in " << resumedPasses << " passes)" << endl;
+        else
+            cout << "No checkpoint found at \"" << checkpoint->getFilename()
+                 << "\", starting from scratch." << endl;
+    }
 
     /* Create a window that visualizes the partially rendered result */
     NoriScreen *screen = nullptr;
     if (gui) {
+        result.enableSnapshot();
         nanogui::init();
         screen = new NoriScreen(result);
     }
@@ -82,40 +428,90 @@ static void render(Scene *scene, const std::string &filename) {
         cout.flush();
         Timer timer;
 
-        tbb::blocked_range<int> range(0, blockGenerator.getBlockCount());
-
-        auto map = [&](const tbb::blocked_range<int> &range) {
-            /* Allocate memory for a small image block to be rendered
-               by the current thread */
-            ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
-                camera->getReconstructionFilter());
+        size_t sampleCount = scene->getSampler()->getSampleCount();
 
-            /* Create a clone of the sampler for the current thread */
-            std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+        /* Pixels to be rendered, which determine the progress (a shard renders roughly its share) */
+        uint64_t shardPixels = (uint64_t) cropSize.prod() / shardCount;
 
-            for (int i=range.begin(); i<range.end(); ++i) {
-                /* Request an image block from the block generator */
-                blockGenerator.next(block);
+        if (!progressive) {
+            Statistics::beginRender(shardPixels * sampleCount);
+            renderPass(scene, merge, 0, (uint32_t) sampleCount, timer,
+                       nullptr, nullptr, tiles.get());
+            cout << "done. (took " << timer.elapsedString() << ")" << endl;
+        } else {
+            /* Render the full image in passes until the target sample
+               count or the time budget is reached. With adaptive sampling,
+               the samples saved in converged pixels are spent on the
+               remaining ones: the passes continue until the image received
+               as many samples as uniform sampling would have taken */
+            size_t target = targetSampleCount > 0 ? (size_t) targetSampleCount : sampleCount;
+            size_t done = (size_t) resumedSampleCount;
+            uint64_t budget = shardPixels * target;
+            int pass = resumedPasses;
+            bool interrupted = false;
+            Timer checkpointTimer;
+            if (moments)
+                Statistics::beginRender(budget - std::min(moments->getTotalSampleCount(), budget));
+            else
+                Statistics::beginRender(shardPixels * (target - std::min(done, target)));
+            cout << endl;
+            uint64_t activePixels = shardPixels;
+            while (moments ? moments->getTotalSampleCount() < budget : done < target) {
+                /* The first adaptive pass takes enough samples to estimate the error */
+                size_t passSpp = (size_t) passSampleCount;
+                if (moments && pass == 0)
+                    passSpp = std::max(passSpp, (size_t) adaptiveMinSamples);
+                uint32_t spp;
+                if (done < target) {
+                    spp = (uint32_t) std::min(passSpp, target - done);
+                } else {
+                    /* Beyond the target, distribute the remaining budget over the
+                       active pixels (at most doubling their samples per pass, since
+                       more of them may converge in the meantime) */
+                    uint64_t remaining = budget - moments->getTotalSampleCount();
+                    spp = (uint32_t) std::max((uint64_t) passSpp,
+                        std::min(remaining / std::max(activePixels, (uint64_t) 1), (uint64_t) done));
+                }
 
-                /* Inform the sampler about the block to be rendered */
-                sampler->prepare(block);
+                bool complete = renderPass(scene, merge, done, spp, timer,
+                                           moments.get(), &activePixels, tiles.get());
+                if (!complete) {
+                    cout << "Time limit reached during pass " << pass + 1 << "." << endl;
+                    interrupted = true;
+                    break;
+                }
+                done += spp;
+                cout << "  pass " << ++pass << ": " << done << "/" << target
+                     << " spp (" << timer.elapsedString() << ")";
+                if (moments)
+                    cout << tfm::format(", %i active pixels, %.1f%% of the sample budget", activePixels,
+                        100.0 * moments->getTotalSampleCount() / std::max(budget, (uint64_t) 1));
+                cout << endl;
 
-                /* Render all contained pixels */
-                renderBlock(scene, sampler.get(), block);
+                if (moments && activePixels == 0)
+                    break;
 
-                /* The image block has been processed. Now add it to
-                   the "big" block that represents the entire image */
-                result.put(block);
+                /* Only complete passes are checkpointed, so that resuming
+                   at sample 'done' never repeats a sample */
+                if (checkpoint && checkpointTimer.elapsed() > checkpointInterval * 1000 &&
+                    checkpoint->save(result, moments.get(), done, pass))
+                    checkpointTimer.reset();
             }
-        };
-
-        /// Default: parallel rendering
-        tbb::parallel_for(range, map);
 
-        /// (equivalent to the following single-threaded call)
-        // map(range);
+            /* Store the final state as well (so that the render can be continued with more samples) */
+            if (checkpoint && !interrupted) {
+                checkpoint->wait();
+                checkpoint->save(result, moments.get(), done, pass);
+            }
+            cout << "done. (" << done << " spp in " << pass << " passes, took "
+                 << timer.elapsedString() << ")" << endl;
 
-        cout << "done. (took " << timer.elapsedString() << ")" << endl;
+            if (moments) {
+                uint64_t total = moments->getTotalSampleCount();
+                cout << tfm::format("Adaptive sampling: %i samples, %.1f%% of the budget of uniform sampling",
+                    total, 100.0 * total / std::max((uint64_t) 1, budget)) << endl;
+            }
+        }
     });
 
     /* Enter the application main loop */
@@ -130,31 +526,250 @@ static void render(Scene *scene, const std::string &filename) {
         nanogui::shutdown();
     }
 
+    /* Remove the remaining noise if the scene specifies a denoiser */
+    if (scene->getDenoiser()) {
+        cout << "Denoising .. ";
+        cout.flush();
+        Timer timer;
+        scene->getDenoiser()->denoise(result, moments.get());
+        cout << "done. (took " << timer.elapsedString() << ")" << endl;
+    }
+
     /* Now turn the rendered image block into
        a properly normalized bitmap */
-    std::unique_ptr<Bitmap> bitmap(result.toBitmap());
+    bool partial = shardCount > 1;
+    std::unique_ptr<Bitmap> bitmap(partial ? result.toUnnormalizedBitmap() : result.toBitmap());
 
-    /* Determine the filename of the output bitmap */
-    std::string outputName = filename;
-    size_t lastdot = outputName.find_last_of(".");
+    /* Select the precision of the layers (partial sums are always stored as floats) */
+    if (!partial) {
+        bitmap->setHalf(isHalfChannel("R"));
+        for (Bitmap::Channel &channel : bitmap->getChannels())
+            channel.half = isHalfChannel(channel.name);
+    }
+
+    /* Insert the crop window into a previously rendered image */
+    if (base)
+        bitmap->composite(*base, cropOffset, cropSize);
+
+    /* Normalize the sample count heatmap for viewing (the raw counts are stored as well) */
+    std::unique_ptr<Bitmap> heatmap, heatmapView;
+    if (moments) {
+        heatmap.reset(moments->toBitmap());
+        heatmapView.reset(new Bitmap(*heatmap));
+        float maxCount = 1.0f;
+        for (int i = 0; i < heatmap->size(); ++i)
+            maxCount = std::max(maxCount, (*heatmap)(i).r());
+        for (int i = 0; i < heatmapView->size(); ++i)
+            (*heatmapView)(i) /= maxCount;
+    }
+
+    /* Partial images are summed by nori-merge, hence they are always stored losslessly */
+    Bitmap::ECompression compression = exrCompression;
+    if (partial && compression != Bitmap::ENoCompression)
+        compression = Bitmap::EZIP;
+
+    auto save = [outputName, outputSize, partial, compression, bitmap = std::move(bitmap), heatmap = std::move(heatmap),
+                 heatmapView = std::move(heatmapView), tiles = std::move(tiles)] {
+        /* Save using the OpenEXR format */
+        bitmap->saveEXR(outputName, compression);
+
+        /* Save tonemapped (sRGB) output using the PNG format */
+        if (!partial)
+            bitmap->savePNG(outputName);
+
+        if (heatmap) {
+            heatmap->saveEXR(outputName + "_spp", exrCompression);
+            heatmapView->savePNG(outputName + "_spp");
+        }
+
+        if (tiles)
+            saveTileStatistics(*tiles, outputSize, outputName);
+    };
+
+    if (writer) {
+        /* Write the files while the caller continues (at most one write is in flight) */
+        if (writer->joinable())
+            writer->join();
+        *writer = std::thread([save = std::move(save), written] {
+            std::string error;
+            try {
+                save();
+            } catch (const std::exception &e) {
+                error = e.what();
+            }
+            if (written)
+                written(error);
+            else if (!error.empty())
+                cerr << "Could not write the output: " << error << endl;
+        });
+    } else {
+        save();
+    }
+}
+
+/**
+ * \brief Render one image per frame of a camera path
+ *
+ * The scene (and its BVH) is loaded only once. The output files of a
+ * frame are written while the next frame is being rendered.
+ */
+static void renderAnimation(Scene *scene, const std::string &filename) {
+    CameraPath path(cameraPathName);
+
+    std::string baseName = filename;
+    size_t lastdot = baseName.find_last_of(".");
     if (lastdot != std::string::npos)
-        outputName.erase(lastdot, std::string::npos);
+        baseName.erase(lastdot, std::string::npos);
+
+    std::thread writer;
+    try {
+        for (size_t frame = 0; frame < path.size(); ++frame) {
+            cout << "Frame " << frame + 1 << "/" << path.size() << endl;
+            scene->getCamera()->setCameraToWorld(path[frame]);
+            render(scene, tfm::format("%s_%04i.exr", baseName, frame), &writer);
+        }
+    } catch (...) {
+        if (writer.joinable())
+            writer.join();
+        throw;
+    }
+
+    if (writer.joinable())
+        writer.join();
+}
+
+/**
+ * \brief Keep the scene in memory and render the requests read from stdin
+ *
+ * This avoids parsing the scene and building the BVH for every image when
+ * many small renders of the same scene are needed. Each line of the input
+ * holds one command:
+ *
+ * <pre>
+ *   camera <camera type="perspective">...</camera>   Replace the camera (likewise
+ *   integrator|sampler|denoiser <...>                 for the other objects)
+ *   spp N                                             Samples per pixel (0: use the sampler's count)
+ *   crop x y width height                             Crop window ("crop off" renders the full image)
+ *   render name                                       Render and write name.exr and name.png
+ *   quit
+ * </pre>
+ *
+ * Settings persist across renders. Every command is answered by a line
+ * on stdout starting with "ok" or "error", while progress messages are
+ * redirected to stderr. The files of a render are written while the next
+ * request is processed, and its reply ("ok name.exr ..") is only sent once
+ * they are complete. It may therefore follow the replies to later commands.
+ */
+static void serve(Scene *scene) {
+    /* Reserve stdout for the replies (which also come from the writer thread) */
+    std::ostream replyStream(cout.rdbuf());
+    std::streambuf *log = cout.rdbuf(cerr.rdbuf());
+    std::mutex replyMutex;
+    auto reply = [&](const std::string &message) {
+        std::lock_guard<std::mutex> lock(replyMutex);
+        replyStream << message << endl;
+    };
+    std::thread writer;
+
+    /* The command line settings serve as defaults for the requests */
+    Point2i requestCropOffset = cropOffset;
+    Vector2i requestCropSize = cropSize;
+    bool baseProgressive = progressive;
+    int baseTargetSampleCount = targetSampleCount, basePassSampleCount = passSampleCount;
+    int spp = 0;
 
-    /* Save using the OpenEXR format */
-    bitmap->saveEXR(outputName);
+    reply("ready");
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream is(line);
+        std::string command;
+        if (!(is >> command))
+            continue;
+
+        try {
+            if (command == "quit") {
+                break;
+            } else if (command == "camera" || command == "integrator" ||
+                       command == "sampler" || command == "denoiser") {
+                std::string xml;
+                std::getline(is, xml);
+                std::unique_ptr<NoriObject> object(loadFromXMLString(xml));
+                if (NoriObject::classTypeName(object->getClassType()) != command)
+                    throw NoriException("Expected a <%s>, got a <%s>!", command,
+                        NoriObject::classTypeName(object->getClassType()));
+                scene->replaceChild(object.release());
+            } else if (command == "spp") {
+                if (!(is >> spp) || spp < 0)
+                    throw NoriException("\"spp\" expects a nonnegative integer!");
+            } else if (command == "crop") {
+                std::string args;
+                std::getline(is >> std::ws, args);
+                if (args == "off") {
+                    requestCropOffset = Point2i(0, 0);
+                    requestCropSize = Vector2i(0, 0);
+                } else {
+                    std::istringstream window(args);
+                    int x, y, width, height;
+                    if (!(window >> x >> y >> width >> height) || width <= 0 || height <= 0)
+                        throw NoriException("\"crop\" expects the offset and (positive) size of the crop window!");
+                    requestCropOffset = Point2i(x, y);
+                    requestCropSize = Vector2i(width, height);
+                }
+            } else if (command == "render") {
+                std::string name;
+                std::getline(is >> std::ws, name);
+                if (name.empty())
+                    throw NoriException("\"render\" expects the name of the output file!");
+
+                /* Apply the settings of this request (render() overwrites the crop window) */
+                cropOffset = requestCropOffset;
+                cropSize = requestCropSize;
+                progressive = spp > 0 || baseProgressive;
+                targetSampleCount = spp > 0 ? spp : baseTargetSampleCount;
+                passSampleCount = spp > 0 && !baseProgressive ? spp : basePassSampleCount;
 
-    /* Save tonemapped (sRGB) output using the PNG format */
-    bitmap->savePNG(outputName);
+                Timer timer;
+                render(scene, name + ".exr", &writer, [&reply, name, timer](std::string error) {
+                    std::replace(error.begin(), error.end(), '\n', ' ');
+                    if (error.empty())
+                        reply("ok " + name + ".exr (took " + timer.elapsedString() + ")");
+                    else
+                        reply("error " + name + ".exr: " + error);
+                });
+                continue;
+            } else {
+                throw NoriException("Unknown command \"%s\"!", command);
+            }
+            reply("ok");
+        } catch (const std::exception &e) {
+            std::string message = e.what();
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            reply("error " + message);
+        }
+    }
+
+    if (writer.joinable())
+        writer.join();
+    reply("ok");
+    cout.rdbuf(log);
 }
 
 int main(int argc, char **argv) {
     if (argc < 2) {
-        cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N]" <<  endl;
+        cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N]"
+                " [--progressive] [--pass-spp N] [--spp N] [--time-limit seconds]"
+                " [--adaptive threshold] [--adaptive-min N]"
+                " [--block-size N] [--block-order spiral|hilbert|scanline]"
+                " [--crop x y width height] [--composite image.exr] [--stream]"
+                " [--checkpoint seconds] [--resume] [--server] [--camera-path file]"
+                " [--shard i/N] [--exr-compression none|zip|piz|dwaa] [--half layers]"
+                " [--tile-stats]" <<  endl;
         return -1;
     }
 
     std::string sceneName = "";
     std::string exrName = "";
+    bool blockOrderSet = false;
 
     for (int i = 1; i < argc; ++i) {
         std::string token(argv[i]);
@@ -172,10 +787,170 @@ int main(int argc, char **argv) {
 
             continue;
         }
+        else if (token == "--checkpoint") {
+            if (i+1 >= argc || atof(argv[i+1]) < 0) {
+                cerr << "\"--checkpoint\" argument expects the number of seconds between checkpoints following it." << endl;
+                return -1;
+            }
+            checkpointInterval = atof(argv[i+1]);
+            progressive = true;
+            i++;
+            continue;
+        }
+        else if (token == "--resume") {
+            resume = true;
+            progressive = true;
+            continue;
+        }
+        else if (token == "--camera-path") {
+            if (i+1 >= argc) {
+                cerr << "\"--camera-path\" argument expects the filename of a camera path following it." << endl;
+                return -1;
+            }
+            cameraPathName = argv[i+1];
+            gui = false;
+            i++;
+            continue;
+        }
+        else if (token == "--exr-compression") {
+            if (i+1 >= argc) {
+                cerr << "\"--exr-compression\" argument expects none, zip, piz or dwaa following it." << endl;
+                return -1;
+            }
+            try {
+                exrCompression = Bitmap::parseCompression(argv[i+1]);
+            } catch (const std::exception &e) {
+                cerr << e.what() << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--half") {
+            if (i+1 >= argc) {
+                cerr << "\"--half\" argument expects a comma-separated list of layers (rgb, AOV names or all) following it." << endl;
+                return -1;
+            }
+            for (const std::string &layer : tokenize(argv[i+1], ", "))
+                halfLayers.push_back(toLower(layer));
+            i++;
+            continue;
+        }
+        else if (token == "--shard") {
+            if (i+1 >= argc || sscanf(argv[i+1], "%i/%i", &shardIndex, &shardCount) != 2 ||
+                shardCount <= 0 || shardIndex < 0 || shardIndex >= shardCount) {
+                cerr << "\"--shard\" argument expects the shard index and count (e.g. 0/4) following it." << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--tile-stats") {
+            tileStats = true;
+            continue;
+        }
+        else if (token == "--server") {
+            server = true;
+            gui = false;
+            continue;
+        }
+        else if (token == "--stream") {
+            streamOutput = true;
+            gui = false;
+            if (!blockOrderSet)
+                blockOrder = BlockGenerator::EScanline;
+            continue;
+        }
         else if (token == "--no-gui") {
             gui = false;
             continue;
         }
+        else if (token == "--progressive") {
+            progressive = true;
+            continue;
+        }
+        else if (token == "--pass-spp" || token == "--spp") {
+            if (i+1 >= argc || atoi(argv[i+1]) <= 0) {
+                cerr << "\"" << token << "\" argument expects a positive integer following it." << endl;
+                return -1;
+            }
+            (token == "--spp" ? targetSampleCount : passSampleCount) = atoi(argv[i+1]);
+            progressive = true;
+            i++;
+            continue;
+        }
+        else if (token == "--block-size") {
+            if (i+1 >= argc || atoi(argv[i+1]) <= 0) {
+                cerr << "\"--block-size\" argument expects a positive integer following it." << endl;
+                return -1;
+            }
+            blockSize = atoi(argv[i+1]);
+            i++;
+            continue;
+        }
+        else if (token == "--block-order") {
+            if (i+1 >= argc) {
+                cerr << "\"--block-order\" argument expects spiral, hilbert or scanline following it." << endl;
+                return -1;
+            }
+            try {
+                blockOrder = BlockGenerator::parseOrder(argv[i+1]);
+                blockOrderSet = true;
+            } catch (const std::exception &e) {
+                cerr << e.what() << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--adaptive") {
+            if (i+1 >= argc || atof(argv[i+1]) <= 0) {
+                cerr << "\"--adaptive\" argument expects a positive relative error threshold following it." << endl;
+                return -1;
+            }
+            adaptiveThreshold = (float) atof(argv[i+1]);
+            progressive = true;
+            i++;
+            continue;
+        }
+        else if (token == "--adaptive-min") {
+            if (i+1 >= argc || atoi(argv[i+1]) < 2) {
+                cerr << "\"--adaptive-min\" argument expects an integer >= 2 following it." << endl;
+                return -1;
+            }
+            adaptiveMinSamples = atoi(argv[i+1]);
+            i++;
+            continue;
+        }
+        else if (token == "--crop") {
+            if (i+4 >= argc || atoi(argv[i+3]) <= 0 || atoi(argv[i+4]) <= 0) {
+                cerr << "\"--crop\" argument expects the offset and (positive) size of the crop window following it." << endl;
+                return -1;
+            }
+            cropOffset = Point2i(atoi(argv[i+1]), atoi(argv[i+2]));
+            cropSize = Vector2i(atoi(argv[i+3]), atoi(argv[i+4]));
+            i += 4;
+            continue;
+        }
+        else if (token == "--composite") {
+            if (i+1 >= argc) {
+                cerr << "\"--composite\" argument expects the filename of an OpenEXR image following it." << endl;
+                return -1;
+            }
+            compositeName = argv[i+1];
+            i++;
+            continue;
+        }
+        else if (token == "--time-limit") {
+            if (i+1 >= argc || atof(argv[i+1]) <= 0) {
+                cerr << "\"--time-limit\" argument expects a positive number of seconds following it." << endl;
+                return -1;
+            }
+            timeLimit = atof(argv[i+1]);
+            progressive = true;
+            i++;
+            continue;
+        }
 
         filesystem::path path(argv[i]);
 
@@ -217,6 +992,7 @@ int main(int argc, char **argv) {
             Bitmap bitmap(exrName);
             ImageBlock block(Vector2i((int) bitmap.cols(), (int) bitmap.rows()), nullptr);
             block.fromBitmap(bitmap);
+            block.enableSnapshot();
             nanogui::init();
             NoriScreen *screen = new NoriScreen(block);
             nanogui::mainloop(50.f);
@@ -231,11 +1007,20 @@ int main(int argc, char **argv) {
         if (threadCount < 0) {
             threadCount = tbb::task_scheduler_init::automatic;
         }
+
+        /* OpenEXR compresses the scanlines of the output files in parallel */
+        Imf::setGlobalThreadCount(threadCount > 0 ? threadCount : (int) std::thread::hardware_concurrency());
         try {
             std::unique_ptr<NoriObject> root(loadFromXML(sceneName));
             /* When the XML root object is a scene, start rendering it .. */
-            if (root->getClassType() == NoriObject::EScene)
-                render(static_cast<Scene *>(root.get()), sceneName);
+            if (root->getClassType() == NoriObject::EScene) {
+                if (server)
+                    serve(static_cast<Scene *>(root.get()));
+                else if (!cameraPathName.empty())
+                    renderAnimation(static_cast<Scene *>(root.get()), sceneName);
+                else
+                    render(static_cast<Scene *>(root.get()), sceneName);
+            }
         } catch (const std::exception &e) {
             cerr << e.what() << endl;
             return -1;
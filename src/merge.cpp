@@ -0,0 +1,61 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/bitmap.h>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <ImfThreading.h>
+
+using namespace nori;
+
+/**
+ * Combines the partial images written by <tt>nori --shard i/N</tt>.
+ *
+ * Each shard stores the unnormalized weighted sums of the blocks it
+ * rendered, along with the summed filter weights. Since the shards render
+ * disjoint sets of blocks, adding them up and dividing by the total weight
+ * yields the same image as a single process would have rendered.
+ *
+ * Syntax: nori-merge <output> <shard.exr> [<shard.exr> ..]
+ *
+ * The result is written to <output>.exr and <output>.png.
+ */
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        cerr << "Syntax: " << argv[0] << " <output> <shard.exr> [<shard.exr> ..]" << endl;
+        return -1;
+    }
+
+    /* Let OpenEXR decompress and compress the scanlines in parallel */
+    Imf::setGlobalThreadCount((int) std::thread::hardware_concurrency());
+
+    try {
+        std::unique_ptr<Bitmap> sum;
+        for (int i = 2; i < argc; ++i) {
+            Bitmap shard(argv[i]);
+            const std::vector<Bitmap::Channel> &channels = shard.getChannels();
+            if (std::find_if(channels.begin(), channels.end(), [](const Bitmap::Channel &c) {
+                    return c.name == "filterWeight"; }) == channels.end())
+                throw NoriException("\"%s\" is not a partial image (it has no filter weights)!", argv[i]);
+
+            if (!sum)
+                sum.reset(new Bitmap(shard));
+            else if (!sum->accumulate(shard))
+                throw NoriException("\"%s\" doesn't match the size or channels of \"%s\"!", argv[i], argv[2]);
+        }
+
+        /* Normalize by the accumulated filter weights (and drop them) */
+        std::unique_ptr<Bitmap> result(sum->normalize());
+        result->saveEXR(argv[1]);
+        result->savePNG(argv[1]);
+    } catch (const std::exception &e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
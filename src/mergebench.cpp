@@ -0,0 +1,157 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/block.h>
+#include <nori/rfilter.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/task_scheduler_init.h>
+#include <thread>
+#include <chrono>
+
+using namespace nori;
+
+/**
+ * Benchmark for merging rendered blocks into the full-frame image block.
+ *
+ * Every thread repeatedly fills a block with constant values and merges it
+ * into the frame, once using a single global lock (the previous strategy)
+ * and once using \ref ImageBlock::put(ImageBlock &). The reported times
+ * only include the merges, which makes contention directly visible.
+ *
+ * Before the benchmark, the merges of tiny blocks (narrower than twice the
+ * filter border, as they occur at the image edges and at the split tail of
+ * a frame) are checked against the serialized result.
+ *
+ * Syntax: mergebench [width height] [blockSize] [frames] [filter]
+ */
+
+/// Merge all blocks of one frame and return the time spent merging (in ms)
+static double mergeFrame(ImageBlock &result, const ReconstructionFilter *filter,
+                         int blockSize, bool globalLock) {
+    BlockGenerator blockGenerator(result.getSize(), blockSize);
+    tbb::blocked_range<int> range(0, blockGenerator.getBlockCount());
+    std::atomic<int64_t> mergeTime(0);
+
+    tbb::parallel_for(range, [&](const tbb::blocked_range<int> &range) {
+        ImageBlock block(Vector2i(blockSize), filter);
+        block.setConstant(Color4f(Color3f(0.5f)));
+
+        for (int i=range.begin(); i<range.end(); ++i) {
+            blockGenerator.next(block);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            if (globalLock) {
+                /* The previous implementation: add the whole bordered block under one lock */
+                Vector2i offset = block.getOffset() - result.getOffset() +
+                    Vector2i::Constant(result.getBorderSize() - block.getBorderSize());
+                Vector2i size = block.getSize() + Vector2i(2*block.getBorderSize());
+                result.lock();
+                result.block(offset.y(), offset.x(), size.y(), size.x())
+                    += block.topLeftCorner(size.y(), size.x());
+                result.unlock();
+            } else {
+                result.put(block);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            mergeTime += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        }
+    });
+
+    return mergeTime * 1e-6;
+}
+
+/**
+ * \brief Check that concurrent merges of tiny blocks lose no updates
+ *
+ * Every block adds the same constant, hence the merged frames must
+ * exactly match a single frame merged under the global lock, scaled
+ * by the number of frames.
+ */
+static bool checkTinyBlocks(const ReconstructionFilter *filter) {
+    const Vector2i size(37, 23);
+    const int frames = 50;
+    for (int blockSize = 1; blockSize <= 5; ++blockSize) {
+        ImageBlock reference(size, filter), result(size, filter);
+        reference.clear();
+        result.clear();
+        {
+            tbb::task_scheduler_init init(1);
+            mergeFrame(reference, filter, blockSize, true);
+        }
+        for (int frame = 0; frame < frames; ++frame)
+            mergeFrame(result, filter, blockSize, false);
+
+        bool lost = false;
+        for (int y = 0; y < result.rows(); ++y)
+            for (int x = 0; x < result.cols(); ++x)
+                lost |= (reference(y, x) * (float) frames != result(y, x)).any();
+        if (lost) {
+            cerr << tfm::format("Merging blocks of %i pixels into a %ix%i image lost updates!",
+                blockSize, size.x(), size.y()) << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Vector2i size(1920, 1080);
+    int blockSize = 16, frames = 20;
+    std::string filterName = "gaussian";
+
+    if (argc >= 3)
+        size = Vector2i(atoi(argv[1]), atoi(argv[2]));
+    if (argc >= 4)
+        blockSize = atoi(argv[3]);
+    if (argc >= 5)
+        frames = atoi(argv[4]);
+    if (argc >= 6)
+        filterName = argv[5];
+
+    if (size.minCoeff() <= 0 || blockSize <= 0 || frames <= 0) {
+        cerr << "Syntax: " << argv[0] << " [width height] [blockSize] [frames] [filter]" << endl;
+        return -1;
+    }
+
+    std::unique_ptr<ReconstructionFilter> filter;
+    try {
+        filter.reset(static_cast<ReconstructionFilter *>(
+            NoriObjectFactory::createInstance(filterName, PropertyList())));
+    } catch (const std::exception &e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+
+    if (!checkTinyBlocks(filter.get()))
+        return -1;
+
+    ImageBlock result(size, filter.get());
+    cout << tfm::format("Merging %i frames of %ix%i pixels (blocks of %i, \"%s\" filter with border %i)",
+        frames, size.x(), size.y(), blockSize, filterName, result.getBorderSize()) << endl;
+    cout << "threads  global lock [ms]  striped locks [ms]  speedup" << endl;
+
+    int maxThreads = std::max(1, (int) std::thread::hardware_concurrency());
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        tbb::task_scheduler_init init(threads);
+        double time[2] = { 0, 0 };
+
+        for (int mode = 0; mode < 2; ++mode) {
+            result.clear();
+            for (int frame = 0; frame < frames; ++frame)
+                time[mode] += mergeFrame(result, filter.get(), blockSize, mode == 0);
+        }
+
+        /* Time per frame, summed over all threads */
+        cout << tfm::format("%7i  %16.3f  %18.3f  %6.2fx", threads,
+            time[0] / frames, time[1] / frames, time[0] / std::max(time[1], 1e-9)) << endl;
+
+        if (threads == maxThreads)
+            break;
+    }
+
+    return 0;
+}
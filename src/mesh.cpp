@@ -25,7 +25,13 @@ void Mesh::activate() {
         /* If no material was assigned, instantiate a diffuse BRDF */
         m_bsdf = static_cast<BSDF *>(NoriObjectFactory::createInstance("diffuse", PropertyList()));
     }
-    if (m_emitter){
+    if (m_emitter && hasMotion()) {
+        /* Emitter sampling uses the vertices at the start of the shutter,
+           which would disagree with the pose hit by the shadow rays */
+        throw NoriException("Mesh \"%s\": moving emitters are not supported "
+                            "(remove \"toWorldEnd\"/\"filenameEnd\" or the emitter)!", m_name);
+    }
+    if (m_emitter && getTriangleCount() > 0){
        // m_emitter->set(this);
         uint32_t n_prims = getTriangleCount();
         dpdf = DiscretePDF(n_prims);
@@ -59,7 +65,9 @@ float Mesh::surfaceArea() const {
 
 bool Mesh::rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const {
     uint32_t i0 = m_F(0, index), i1 = m_F(1, index), i2 = m_F(2, index);
-    const Point3f p0 = m_V.col(i0), p1 = m_V.col(i1), p2 = m_V.col(i2);
+    const Point3f p0 = getVertexPosition(i0, ray.time),
+                  p1 = getVertexPosition(i1, ray.time),
+                  p2 = getVertexPosition(i2, ray.time);
 
     /* Find vectors for two edges sharing v[0] */
     Vector3f edge1 = p1 - p0, edge2 = p2 - p0;
@@ -100,14 +108,71 @@ BoundingBox3f Mesh::getBoundingBox(uint32_t index) const {
     BoundingBox3f result(m_V.col(m_F(0, index)));
     result.expandBy(m_V.col(m_F(1, index)));
     result.expandBy(m_V.col(m_F(2, index)));
+    if (hasMotion()) {
+        /* Linear motion: the two keyframes bound all in-between poses */
+        result.expandBy(m_V1.col(m_F(0, index)));
+        result.expandBy(m_V1.col(m_F(1, index)));
+        result.expandBy(m_V1.col(m_F(2, index)));
+    }
+    return result;
+}
+
+BoundingBox3f Mesh::getBoundingBox(uint32_t index, float time) const {
+    BoundingBox3f result(getVertexPosition(m_F(0, index), time));
+    result.expandBy(getVertexPosition(m_F(1, index), time));
+    result.expandBy(getVertexPosition(m_F(2, index), time));
     return result;
 }
 
 Point3f Mesh::getCentroid(uint32_t index) const {
     return (1.0f / 3.0f) *
-        (m_V.col(m_F(0, index)) +
-         m_V.col(m_F(1, index)) +
-         m_V.col(m_F(2, index)));
+        (getVertexPosition(m_F(0, index), 0.5f) +
+         getVertexPosition(m_F(1, index), 0.5f) +
+         getVertexPosition(m_F(2, index), 0.5f));
+}
+
+void Mesh::setHitInformation(uint32_t index, const Ray3f &ray, Intersection &its) const {
+    /* Find the barycentric coordinates */
+    Vector3f bary;
+    bary << 1-its.uv.sum(), its.uv;
+
+    its.time = ray.time;
+
+    /* Vertex indices of the triangle */
+    uint32_t idx0 = m_F(0, index), idx1 = m_F(1, index), idx2 = m_F(2, index);
+
+    /* Vertex positions at the time of the ray */
+    Point3f p0 = getVertexPosition(idx0, ray.time),
+            p1 = getVertexPosition(idx1, ray.time),
+            p2 = getVertexPosition(idx2, ray.time);
+
+    /* Compute the intersection positon accurately
+       using barycentric coordinates */
+    its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
+
+    /* Compute proper texture coordinates if provided by the mesh */
+    if (m_UV.size() > 0)
+        its.uv = bary.x() * m_UV.col(idx0) +
+            bary.y() * m_UV.col(idx1) +
+            bary.z() * m_UV.col(idx2);
+
+    /* Compute the geometry frame */
+    its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
+
+    if (m_N.size() > 0) {
+        /* Compute the shading frame. Note that for simplicity,
+           the current implementation doesn't attempt to provide
+           tangents that are continuous across the surface. That
+           means that this code will need to be modified to be able
+           use anisotropic BRDFs, which need tangent continuity */
+
+        its.shFrame = Frame(
+            (bary.x() * getVertexNormal(idx0, ray.time) +
+             bary.y() * getVertexNormal(idx1, ray.time) +
+             bary.z() * getVertexNormal(idx2, ray.time)).normalized());
+    } else {
+        its.shFrame = its.geoFrame;
+    }
 }
 
 void Mesh::addChild(NoriObject *obj) {
@@ -157,18 +222,28 @@ const EmitterQueryRecord Mesh::sample(Sampler* sampler) const {
     return EmitterQueryRecord(p, n, pdf);
 }
 
+const EmitterQueryRecord Mesh::sample(const Point3f &, Sampler* sampler) const {
+    return sample(sampler);
+}
+
+float Mesh::pdf(const Point3f &, const EmitterQueryRecord &) const {
+    return dpdf.getNormalization();
+}
+
 std::string Mesh::toString() const {
     return tfm::format(
         "Mesh[\n"
         "  name = \"%s\",\n"
         "  vertexCount = %i,\n"
         "  triangleCount = %i,\n"
+        "  motion = %s,\n"
         "  bsdf = %s,\n"
         "  emitter = %s\n"
         "]",
         m_name,
         m_V.cols(),
         m_F.cols(),
+        hasMotion() ? "true" : "false",
         m_bsdf ? indent(m_bsdf->toString()) : std::string("null"),
         m_emitter ? indent(m_emitter->toString()) : std::string("null")
     );
@@ -183,6 +258,7 @@ std::string Intersection::toString() const {
         "  p = %s,\n"
         "  t = %f,\n"
         "  uv = %s,\n"
+        "  time = %f,\n"
         "  shFrame = %s,\n"
         "  geoFrame = %s,\n"
         "  mesh = %s\n"
@@ -190,6 +266,7 @@ std::string Intersection::toString() const {
         p.toString(),
         t,
         uv.toString(),
+        time,
         indent(shFrame.toString()),
         indent(geoFrame.toString()),
         mesh ? mesh->toString() : std::string("null")
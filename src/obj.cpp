@@ -14,6 +14,10 @@ NORI_NAMESPACE_BEGIN
 
 /**
  * \brief Loader for Wavefront OBJ triangle meshes
+ *
+ * Moving meshes can be specified by providing a second keyframe for the
+ * end of the shutter interval, either as a transformation (\c toWorldEnd)
+ * or as a second OBJ file with identical topology (\c filenameEnd).
  */
 class WavefrontOBJ : public Mesh {
 public:
@@ -27,6 +31,9 @@ public:
         if (is.fail())
             throw NoriException("Unable to open OBJ file \"%s\"!", filename);
         Transform trafo = propList.getTransform("toWorld", Transform());
+        Transform trafoEnd;
+        bool hasTrafoEnd = propList.hasTransform("toWorldEnd", trafoEnd);
+        std::string filenameEnd = propList.getString("filenameEnd", "");
 
         cout << "Loading \"" << filename << "\" .. ";
         cout.flush();
@@ -49,8 +56,6 @@ public:
             if (prefix == "v") {
                 Point3f p;
                 line >> p.x() >> p.y() >> p.z();
-                p = trafo * p;
-                m_bbox.expandBy(p);
                 positions.push_back(p);
             } else if (prefix == "vt") {
                 Point2f tc;
@@ -59,7 +64,7 @@ public:
             } else if (prefix == "vn") {
                 Normal3f n;
                 line >> n.x() >> n.y() >> n.z();
-                normals.push_back((trafo * n).normalized());
+                normals.push_back(n);
             } else if (prefix == "f") {
                 std::string v1, v2, v3, v4;
                 line >> v1 >> v2 >> v3 >> v4;
@@ -96,13 +101,37 @@ public:
         memcpy(m_F.data(), indices.data(), sizeof(uint32_t)*indices.size());
 
         m_V.resize(3, vertices.size());
-        for (uint32_t i=0; i<vertices.size(); ++i)
-            m_V.col(i) = positions.at(vertices[i].p-1);
+        for (uint32_t i=0; i<vertices.size(); ++i) {
+            Point3f p = trafo * Point3f(positions.at(vertices[i].p-1));
+            m_bbox.expandBy(p);
+            m_V.col(i) = p;
+        }
 
         if (!normals.empty()) {
             m_N.resize(3, vertices.size());
             for (uint32_t i=0; i<vertices.size(); ++i)
-                m_N.col(i) = normals.at(vertices[i].n-1);
+                m_N.col(i) = (trafo * Normal3f(normals.at(vertices[i].n-1))).normalized();
+        }
+
+        /* Second keyframe at the end of the shutter interval */
+        if (!filenameEnd.empty() || hasTrafoEnd) {
+            if (!hasTrafoEnd)
+                trafoEnd = trafo;
+            if (!filenameEnd.empty())
+                loadKeyframe(filenameEnd, positions, normals);
+
+            m_V1.resize(3, vertices.size());
+            for (uint32_t i=0; i<vertices.size(); ++i) {
+                Point3f p = trafoEnd * Point3f(positions.at(vertices[i].p-1));
+                m_bbox.expandBy(p);
+                m_V1.col(i) = p;
+            }
+
+            if (!normals.empty()) {
+                m_N1.resize(3, vertices.size());
+                for (uint32_t i=0; i<vertices.size(); ++i)
+                    m_N1.col(i) = (trafoEnd * Normal3f(normals.at(vertices[i].n-1))).normalized();
+            }
         }
 
         if (!texcoords.empty()) {
@@ -115,11 +144,51 @@ public:
         cout << "done. (V=" << m_V.cols() << ", F=" << m_F.cols() << ", took "
              << timer.elapsedString() << " and "
              << memString(m_F.size() * sizeof(uint32_t) +
-                          sizeof(float) * (m_V.size() + m_N.size() + m_UV.size()))
+                          sizeof(float) * (m_V.size() + m_N.size() + m_UV.size() +
+                                           m_V1.size() + m_N1.size()))
              << ")" << endl;
     }
 
 protected:
+    /**
+     * \brief Replace the vertex positions and normals by those of a second
+     * OBJ file with identical topology (used for vertex keyframes)
+     */
+    static void loadKeyframe(const std::string &name, std::vector<Vector3f> &positions,
+                             std::vector<Vector3f> &normals) {
+        filesystem::path filename = getFileResolver()->resolve(name);
+        std::ifstream is(filename.str());
+        if (is.fail())
+            throw NoriException("Unable to open OBJ file \"%s\"!", filename);
+
+        std::vector<Vector3f> positionsEnd, normalsEnd;
+        std::string line_str;
+        while (std::getline(is, line_str)) {
+            std::istringstream line(line_str);
+
+            std::string prefix;
+            line >> prefix;
+
+            if (prefix == "v") {
+                Point3f p;
+                line >> p.x() >> p.y() >> p.z();
+                positionsEnd.push_back(p);
+            } else if (prefix == "vn") {
+                Normal3f n;
+                line >> n.x() >> n.y() >> n.z();
+                normalsEnd.push_back(n);
+            }
+        }
+
+        if (positionsEnd.size() != positions.size() ||
+            (!normals.empty() && normalsEnd.size() != normals.size()))
+            throw NoriException("OBJ keyframe \"%s\" does not match the topology of the first keyframe!", filename);
+
+        positions = std::move(positionsEnd);
+        if (!normals.empty())
+            normals = std::move(normalsEnd);
+    }
+
     /// Vertex indices used by the OBJ format
     struct OBJVertex {
         uint32_t p = (uint32_t) -1;
@@ -9,18 +9,33 @@
 #include <Eigen/Geometry>
 #include <pugixml.hpp>
 #include <fstream>
+#include <sstream>
 #include <set>
+#include <memory>
 
 NORI_NAMESPACE_BEGIN
 
-NoriObject *loadFromXML(const std::string &filename) {
+/**
+ * \brief Parse a Nori XML document and return its root object
+ *
+ * \param filename
+ *     Name of the document (used in error messages)
+ * \param contents
+ *     The document itself, or \c nullptr to load it from \c filename
+ */
+static NoriObject *parseXML(const std::string &filename, const std::string *contents) {
     /* Load the XML file using 'pugi' (a tiny self-contained XML parser implemented in C++) */
     pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_file(filename.c_str());
+    pugi::xml_parse_result result = contents
+        ? doc.load_buffer(contents->data(), contents->size())
+        : doc.load_file(filename.c_str());
 
     /* Helper function: map a position offset in bytes to a more readable line/column value */
     auto offset = [&](ptrdiff_t pos) -> std::string {
-        std::fstream is(filename);
+        std::unique_ptr<std::istream> stream(contents
+            ? static_cast<std::istream *>(new std::istringstream(*contents))
+            : static_cast<std::istream *>(new std::ifstream(filename)));
+        std::istream &is = *stream;
         char buffer[1024];
         int line = 0, linestart = 0, offset = 0;
         while (is.good()) {
@@ -56,6 +71,7 @@ NoriObject *loadFromXML(const std::string &filename) {
         ETest                 = NoriObject::ETest,
         EReconstructionFilter = NoriObject::EReconstructionFilter,
         ETexture              = NoriObject::ETexture,
+        EDenoiser             = NoriObject::EDenoiser,
         /* Properties */
         EBoolean = NoriObject::EClassTypeCount,
         EInteger,
@@ -102,6 +118,7 @@ NoriObject *loadFromXML(const std::string &filename) {
     tags["lookat"]     = ELookAt;
     // additional tags
     tags["texture"]    = ETexture;
+    tags["denoiser"]   = EDenoiser;
 
     /* Helper function to check if attributes are fully specified */
     auto check_attributes = [&](const pugi::xml_node &node, std::set<std::string> attrs) {
@@ -306,4 +323,12 @@ NoriObject *loadFromXML(const std::string &filename) {
     return parseTag(*doc.begin(), list, EInvalid);
 }
 
+NoriObject *loadFromXML(const std::string &filename) {
+    return parseXML(filename, nullptr);
+}
+
+NoriObject *loadFromXMLString(const std::string &xml) {
+    return parseXML("<string>", &xml);
+}
+
 NORI_NAMESPACE_END
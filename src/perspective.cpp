@@ -25,6 +25,15 @@ public:
         m_outputSize.y() = propList.getInteger("height", 720);
         m_invOutputSize = m_outputSize.cast<float>().cwiseInverse();
 
+        /* Optional crop window: only this region of the image is rendered. Default: everything */
+        m_cropOffset.x() = propList.getInteger("cropOffsetX", 0);
+        m_cropOffset.y() = propList.getInteger("cropOffsetY", 0);
+        m_cropSize.x() = propList.getInteger("cropWidth", m_outputSize.x() - m_cropOffset.x());
+        m_cropSize.y() = propList.getInteger("cropHeight", m_outputSize.y() - m_cropOffset.y());
+        if ((m_cropOffset.array() < 0).any() || (m_cropSize.array() <= 0).any() ||
+            ((m_cropOffset + m_cropSize).array() > m_outputSize.array()).any())
+            throw NoriException("PerspectiveCamera: the crop window must lie within the image!");
+
         /* Specifies an optional camera-to-world transformation. Default: none */
         m_cameraToWorld = propList.getTransform("toWorld", Transform());
 
@@ -35,9 +44,23 @@ public:
         m_nearClip = propList.getFloat("nearClip", 1e-4f);
         m_farClip = propList.getFloat("farClip", 1e4f);
 
+        /* Shutter interval, relative to the keyframes of moving meshes at 0 and 1 */
+        m_shutterOpen = propList.getFloat("shutterOpen", 0.0f);
+        m_shutterClose = propList.getFloat("shutterClose", 1.0f);
+        if (!(0.0f <= m_shutterOpen && m_shutterOpen <= m_shutterClose && m_shutterClose <= 1.0f))
+            throw NoriException("PerspectiveCamera: the shutter interval must satisfy "
+                                "0 <= shutterOpen <= shutterClose <= 1!");
+
+        /* Comma-separated list of output variables, e.g. "albedo,normal,depth" */
+        m_aovs = AOVList(propList.getString("aovs", ""));
+
         m_rfilter = NULL;
     }
 
+    void setCameraToWorld(const Transform &cameraToWorld) {
+        m_cameraToWorld = cameraToWorld;
+    }
+
     void activate() {
         float aspect = m_outputSize.x() / (float) m_outputSize.y();
 
@@ -116,15 +139,23 @@ public:
             "PerspectiveCamera[\n"
             "  cameraToWorld = %s,\n"
             "  outputSize = %s,\n"
+            "  crop = %s + %s,\n"
             "  fov = %f,\n"
             "  clip = [%f, %f],\n"
+            "  shutter = [%f, %f],\n"
+            "  aovs = %s,\n"
             "  rfilter = %s\n"
             "]",
             indent(m_cameraToWorld.toString(), 18),
             m_outputSize.toString(),
+            m_cropOffset.toString(),
+            m_cropSize.toString(),
             m_fov,
             m_nearClip,
             m_farClip,
+            m_shutterOpen,
+            m_shutterClose,
+            m_aovs.toString(),
             indent(m_rfilter->toString())
         );
     }
@@ -0,0 +1,216 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+#include <nori/emitter.h>
+#include <nori/sampler.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Analytic rectangle (quad)
+ *
+ * Covers the square [-1, 1]^2 in the XY plane with a normal pointing along
+ * +Z, which is placed into the scene using the \c toWorld transformation.
+ *
+ * When used as an area emitter and the transformed edges are orthogonal
+ * (i.e. no shear), positions are generated by sampling the solid angle of
+ * the rectangle as seen from the reference point using the method of
+ *
+ * "An Area-Preserving Parametrization for Spherical Rectangles"
+ * by Carlos Urena, Marcos Fajardo and Alan King (EGSR 2013).
+ *
+ * Otherwise, and for very small solid angles, where this mapping becomes
+ * unstable, the area is sampled uniformly.
+ */
+class RectangleShape : public Mesh {
+public:
+    RectangleShape(const PropertyList &propList) {
+        Transform trafo = propList.getTransform("toWorld", Transform());
+
+        m_corner = trafo * Point3f(-1.f, -1.f, 0.f);
+        m_edge0 = trafo * Point3f(1.f, -1.f, 0.f) - m_corner;
+        m_edge1 = trafo * Point3f(-1.f, 1.f, 0.f) - m_corner;
+        Vector3f cross = m_edge0.cross(m_edge1);
+        m_area = cross.norm();
+        if (m_area == 0.f)
+            throw NoriException("Rectangle: the transformation is degenerate!");
+        m_normal = cross / m_area;
+        m_orthogonal = std::abs(m_edge0.normalized().dot(m_edge1.normalized())) < 1e-4f;
+
+        m_bbox = BoundingBox3f(m_corner);
+        m_bbox.expandBy(m_corner + m_edge0);
+        m_bbox.expandBy(m_corner + m_edge1);
+        m_bbox.expandBy(m_corner + m_edge0 + m_edge1);
+        m_name = "rectangle";
+    }
+
+    uint32_t getPrimitiveCount() const { return 1; }
+
+    float surfaceArea() const { return m_area; }
+
+    BoundingBox3f getBoundingBox(uint32_t) const { return m_bbox; }
+
+    BoundingBox3f getBoundingBox(uint32_t, float) const { return m_bbox; }
+
+    Point3f getCentroid(uint32_t) const { return m_corner + 0.5f * (m_edge0 + m_edge1); }
+
+    bool rayIntersect(uint32_t, const Ray3f &ray, float &u, float &v, float &t) const {
+        /* Moeller-Trumbore, but accepting the whole parallelogram */
+        Vector3f pvec = ray.d.cross(m_edge1);
+        float det = m_edge0.dot(pvec);
+        if (det > -1e-8f && det < 1e-8f)
+            return false;
+        float inv_det = 1.0f / det;
+
+        Vector3f tvec = ray.o - m_corner;
+        u = tvec.dot(pvec) * inv_det;
+        if (u < 0.f || u > 1.f)
+            return false;
+
+        Vector3f qvec = tvec.cross(m_edge0);
+        v = ray.d.dot(qvec) * inv_det;
+        if (v < 0.f || v > 1.f)
+            return false;
+
+        t = m_edge1.dot(qvec) * inv_det;
+        return t >= ray.mint && t <= ray.maxt;
+    }
+
+    void setHitInformation(uint32_t, const Ray3f &ray, Intersection &its) const {
+        its.p = m_corner + its.uv.x() * m_edge0 + its.uv.y() * m_edge1;
+        its.time = ray.time;
+        its.geoFrame = its.shFrame = Frame(m_normal);
+    }
+
+    const EmitterQueryRecord sample(Sampler *sampler) const {
+        Point2f sample = sampler->next2D();
+        return EmitterQueryRecord(m_corner + sample.x() * m_edge0 + sample.y() * m_edge1,
+                                  m_normal, 1.f / m_area);
+    }
+
+    const EmitterQueryRecord sample(const Point3f &ref, Sampler *sampler) const {
+        SphericalRectangle sq;
+        if (!initSphericalRectangle(ref, sq))
+            return sample(sampler);
+
+        Point2f sample = sampler->next2D();
+
+        /* Compute the 'x' coordinate of the sample */
+        float au = sample.x() * sq.S + sq.k;
+        float fu = (std::cos(au) * sq.b0 - sq.b1) / std::sin(au);
+        float cu = std::copysign(1.f, fu) / std::sqrt(fu * fu + sq.b0 * sq.b0);
+        cu = clamp(cu, -1.f, 1.f);
+        float xu = -(cu * sq.z0) / std::sqrt(std::max(1e-12f, 1.f - cu * cu));
+        xu = clamp(xu, sq.x0, sq.x1);
+
+        /* Compute the 'y' coordinate of the sample */
+        float d = std::sqrt(xu * xu + sq.z0 * sq.z0);
+        float h0 = sq.y0 / std::sqrt(d * d + sq.y0 * sq.y0);
+        float h1 = sq.y1 / std::sqrt(d * d + sq.y1 * sq.y1);
+        float hv = h0 + sample.y() * (h1 - h0), hv2 = hv * hv;
+        float yv = (hv2 < 1.f - 1e-6f) ? (hv * d) / std::sqrt(1.f - hv2) : sq.y1;
+
+        EmitterQueryRecord eRec(ref + xu * sq.x + yv * sq.y + sq.z0 * sq.z, m_normal, 0.f);
+        eRec.pdf = pdf(ref, eRec);
+        return eRec;
+    }
+
+    float pdf(const Point3f &ref, const EmitterQueryRecord &eRec) const {
+        SphericalRectangle sq;
+        if (!initSphericalRectangle(ref, sq))
+            return 1.f / m_area;
+
+        /* Uniform density over the solid angle, converted to the area measure */
+        Vector3f d = ref - eRec.p;
+        float dist2 = d.squaredNorm();
+        if (dist2 == 0.f)
+            return 0.f;
+        return std::abs(m_normal.dot(d)) / (dist2 * std::sqrt(dist2) * sq.S);
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "Rectangle[\n"
+            "  corner = %s,\n"
+            "  edge0 = %s,\n"
+            "  edge1 = %s,\n"
+            "  bsdf = %s,\n"
+            "  emitter = %s\n"
+            "]",
+            m_corner.toString(),
+            m_edge0.toString(),
+            m_edge1.toString(),
+            m_bsdf ? indent(m_bsdf->toString()) : std::string("null"),
+            m_emitter ? indent(m_emitter->toString()) : std::string("null")
+        );
+    }
+
+protected:
+    /// Rectangle as seen from a reference point (in a local frame centered there)
+    struct SphericalRectangle {
+        Vector3f x, y, z;
+        float z0, x0, y0, x1, y1;
+        float b0, b1, k, S;
+    };
+
+    /// Set up solid angle sampling, returns \c false when area sampling must be used
+    bool initSphericalRectangle(const Point3f &ref, SphericalRectangle &sq) const {
+        if (!m_orthogonal)
+            return false;
+
+        float len0 = m_edge0.norm(), len1 = m_edge1.norm();
+        sq.x = m_edge0 / len0;
+        sq.y = m_edge1 / len1;
+        sq.z = sq.x.cross(sq.y);
+
+        Vector3f d = m_corner - ref;
+        sq.z0 = d.dot(sq.z);
+        if (sq.z0 > 0.f) {
+            sq.z = -sq.z;
+            sq.z0 = -sq.z0;
+        }
+        sq.x0 = d.dot(sq.x);
+        sq.y0 = d.dot(sq.y);
+        sq.x1 = sq.x0 + len0;
+        sq.y1 = sq.y0 + len1;
+
+        /* The reference point lies (nearly) in the plane of the rectangle */
+        if (std::abs(sq.z0) < 1e-5f * std::max(len0, len1))
+            return false;
+
+        /* Normals of the planes through the reference point and the edges */
+        Vector3f v00(sq.x0, sq.y0, sq.z0), v01(sq.x0, sq.y1, sq.z0),
+                 v10(sq.x1, sq.y0, sq.z0), v11(sq.x1, sq.y1, sq.z0);
+        Vector3f n0 = v00.cross(v10).normalized(), n1 = v10.cross(v11).normalized(),
+                 n2 = v11.cross(v01).normalized(), n3 = v01.cross(v00).normalized();
+
+        /* Internal angles of the spherical rectangle */
+        float g0 = std::acos(clamp(-n0.dot(n1), -1.f, 1.f)),
+              g1 = std::acos(clamp(-n1.dot(n2), -1.f, 1.f)),
+              g2 = std::acos(clamp(-n2.dot(n3), -1.f, 1.f)),
+              g3 = std::acos(clamp(-n3.dot(n0), -1.f, 1.f));
+
+        sq.b0 = n0.z();
+        sq.b1 = n2.z();
+        sq.k = 2.f * M_PI - g2 - g3;
+        sq.S = g0 + g1 - sq.k;
+
+        /* The mapping loses precision for tiny solid angles */
+        return sq.S > 1e-5f;
+    }
+
+protected:
+    Point3f m_corner;
+    Vector3f m_edge0, m_edge1;
+    Normal3f m_normal;
+    float m_area;
+    bool m_orthogonal;
+};
+
+NORI_REGISTER_CLASS(RectangleShape, "rectangle");
+NORI_NAMESPACE_END
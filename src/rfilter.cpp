@@ -15,7 +15,8 @@ NORI_NAMESPACE_BEGIN
  */
 class GaussianFilter : public ReconstructionFilter {
 public:
-    GaussianFilter(const PropertyList &propList) {
+    GaussianFilter(const PropertyList &propList)
+        : ReconstructionFilter(propList) {
         /* Half filter size */
         m_radius = propList.getFloat("radius", 2.0f);
         /* Standard deviation of the Gaussian */
@@ -30,7 +31,8 @@ public:
     }
 
     std::string toString() const {
-        return tfm::format("GaussianFilter[radius=%f, stddev=%f]", m_radius, m_stddev);
+        return tfm::format("GaussianFilter[radius=%f, stddev=%f, importanceSample=%s]",
+            m_radius, m_stddev, m_importanceSample ? "true" : "false");
     }
 protected:
     float m_stddev;
@@ -44,7 +46,8 @@ protected:
  */
 class MitchellNetravaliFilter : public ReconstructionFilter {
 public:
-    MitchellNetravaliFilter(const PropertyList &propList) {
+    MitchellNetravaliFilter(const PropertyList &propList)
+        : ReconstructionFilter(propList) {
         /* Filter size in pixels */
         m_radius = propList.getFloat("radius", 2.0f);
         /* B parameter from the paper */
@@ -69,7 +72,8 @@ public:
     }
 
     std::string toString() const {
-        return tfm::format("MitchellNetravaliFilter[radius=%f, B=%f, C=%f]", m_radius, m_B, m_C);
+        return tfm::format("MitchellNetravaliFilter[radius=%f, B=%f, C=%f, importanceSample=%s]",
+            m_radius, m_B, m_C, m_importanceSample ? "true" : "false");
     }
 protected:
     float m_B, m_C;
@@ -78,7 +82,8 @@ protected:
 /// Tent filter 
 class TentFilter : public ReconstructionFilter {
 public:
-    TentFilter(const PropertyList &) {
+    TentFilter(const PropertyList &propList)
+        : ReconstructionFilter(propList) {
         m_radius = 1.0f;
     }
 
@@ -87,14 +92,15 @@ public:
     }
     
     std::string toString() const {
-        return "TentFilter[]";
+        return tfm::format("TentFilter[importanceSample=%s]", m_importanceSample ? "true" : "false");
     }
 };
 
 /// Box filter -- fastest, but prone to aliasing
 class BoxFilter : public ReconstructionFilter {
 public:
-    BoxFilter(const PropertyList &) {
+    BoxFilter(const PropertyList &propList)
+        : ReconstructionFilter(propList) {
         m_radius = 0.5f;
     }
 
@@ -103,7 +109,7 @@ public:
     }
     
     std::string toString() const {
-        return "BoxFilter[]";
+        return tfm::format("BoxFilter[importanceSample=%s]", m_importanceSample ? "true" : "false");
     }
 };
 
@@ -0,0 +1,130 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+#include <hypothesis.h>
+#include <numeric>
+
+using namespace nori;
+
+/**
+ * Checks the 2D point sets of the stratified samplers
+ *
+ * For every pixel and dimension, the first \c sampleCount points must
+ * occupy each cell of the <tt>cols x rows</tt> grid exactly once. The
+ * points of \c cmj must furthermore be stratified in \c sampleCount
+ * intervals along each axis (n-rooks).
+ *
+ * A set can satisfy all of this and still be badly correlated, e.g. when
+ * the point in column \c k of every row always lies in the \c k-th
+ * sub-stratum of its cell along y. Since the shuffles differ per pixel
+ * and dimension, the pair (column, sub-stratum along y) must be uniformly
+ * distributed over many pixels, and likewise the pair (row, sub-stratum
+ * along x). Both are verified with a Chi^2 test. Only the first row
+ * (column) of each set is counted, since \c cmj deliberately repeats
+ * the sub-strata of one row in all other rows.
+ *
+ * Syntax: samplecheck [sampler] [sampleCount] [pixels]
+ */
+
+/// Run a Chi^2 test of a histogram against the uniform distribution
+static bool chi2(const std::vector<double> &histogram, int sampleCount, int testCount) {
+    if (histogram.size() < 2)
+        return true;
+    std::vector<double> expected(histogram.size(), (double) sampleCount / histogram.size());
+    std::pair<bool, std::string> result = hypothesis::chi2_test((int) histogram.size(),
+        histogram.data(), expected.data(), sampleCount, 5, 0.01f, testCount);
+    if (!result.first)
+        cerr << result.second << endl;
+    return result.first;
+}
+
+static bool check(const std::string &name, int sampleCount, int pixels, int testCount) {
+    PropertyList props;
+    props.setInteger("sampleCount", sampleCount);
+    std::unique_ptr<Sampler> sampler(static_cast<Sampler *>(
+        NoriObjectFactory::createInstance(name, props)));
+
+    const int dimensions = 4;
+    int cols = std::max(1, (int) std::sqrt((float) sampleCount));
+    int rows = (sampleCount + cols - 1) / cols;
+    bool stratified = name == "stratified" || name == "cmj";
+    bool exact = stratified && cols * rows == sampleCount, nRooks = name == "cmj";
+
+    std::vector<double> columnHist(cols * cols, 0.0), rowHist(rows * rows, 0.0);
+    std::vector<std::vector<Point2f>> points(dimensions, std::vector<Point2f>(sampleCount));
+    int failures = 0;
+
+    for (int pixel = 0; pixel < pixels; ++pixel) {
+        sampler->generate(Point2i(pixel % 256, pixel / 256));
+        for (int i = 0; i < sampleCount; ++i) {
+            for (int d = 0; d < dimensions; ++d)
+                points[d][i] = sampler->next2D();
+            sampler->advance();
+        }
+
+        for (int d = 0; d < dimensions; ++d) {
+            std::vector<int> cells(cols * rows, 0), xs(sampleCount, 0), ys(sampleCount, 0);
+            for (const Point2f &p : points[d]) {
+                /* Products in double precision are exact, hence points never change their stratum */
+                double px = p.x(), py = p.y();
+                int x = (int) (px * cols), y = (int) (py * rows);
+                cells[y * cols + x]++;
+                xs[(int) (px * sampleCount)]++;
+                ys[(int) (py * sampleCount)]++;
+
+                /* Column vs. sub-stratum along y, row vs. sub-stratum along x */
+                if (y == 0)
+                    columnHist[x * cols + (int) (py * rows * cols) % cols] += 1;
+                if (x == 0)
+                    rowHist[y * rows + (int) (px * cols * rows) % rows] += 1;
+            }
+
+            bool valid = !exact || std::count(cells.begin(), cells.end(), 1) == sampleCount;
+            if (exact && nRooks)
+                valid &= std::count(xs.begin(), xs.end(), 1) == sampleCount &&
+                         std::count(ys.begin(), ys.end(), 1) == sampleCount;
+            if (!valid && failures++ == 0)
+                cerr << tfm::format("Pixel %i, dimension %i: the points are not stratified!", pixel, d) << endl;
+        }
+    }
+
+    bool passed = failures == 0;
+    passed &= chi2(columnHist, (int) std::accumulate(columnHist.begin(), columnHist.end(), 0.0), testCount);
+    passed &= chi2(rowHist, (int) std::accumulate(rowHist.begin(), rowHist.end(), 0.0), testCount);
+
+    cout << tfm::format("\"%s\" sampler, %i samples per pixel: %s", name, sampleCount,
+        passed ? "passed" : "FAILED") << endl;
+    return passed;
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> samplers = { "stratified", "cmj" };
+    int sampleCount = 16, pixels = 4096;
+
+    if (argc >= 2)
+        samplers = { argv[1] };
+    if (argc >= 3)
+        sampleCount = atoi(argv[2]);
+    if (argc >= 4)
+        pixels = atoi(argv[3]);
+
+    if (sampleCount <= 0 || pixels <= 0) {
+        cerr << "Syntax: " << argv[0] << " [sampler] [sampleCount] [pixels]" << endl;
+        return -1;
+    }
+
+    bool passed = true;
+    try {
+        for (const std::string &name : samplers)
+            passed &= check(name, sampleCount, pixels, 2 * (int) samplers.size());
+    } catch (const std::exception &e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+
+    return passed ? 0 : -1;
+}
@@ -10,6 +10,7 @@
 #include <nori/sampler.h>
 #include <nori/camera.h>
 #include <nori/emitter.h>
+#include <nori/denoiser.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -22,6 +23,7 @@ Scene::~Scene() {
     delete m_sampler;
     delete m_camera;
     delete m_integrator;
+    delete m_denoiser;
 }
 
 void Scene::activate() {
@@ -48,6 +50,7 @@ void Scene::addChild(NoriObject *obj) {
         case EMesh: {
                 Mesh *mesh = static_cast<Mesh *>(obj);
                 m_accel->addMesh(mesh);
+                mesh->setObjectID((uint32_t) m_meshes.size());
                 m_meshes.push_back(mesh);
 
                 Emitter* e = mesh->getEmitter();
@@ -82,12 +85,57 @@ void Scene::addChild(NoriObject *obj) {
             m_integrator = static_cast<Integrator *>(obj);
             break;
 
+        case EDenoiser:
+            if (m_denoiser)
+                throw NoriException("There can only be one denoiser per scene!");
+            m_denoiser = static_cast<Denoiser *>(obj);
+            break;
+
         default:
             throw NoriException("Scene::addChild(<%s>) is not supported!",
                 classTypeName(obj->getClassType()));
     }
 }
 
+void Scene::replaceChild(NoriObject *obj) {
+    switch (obj->getClassType()) {
+        case ESampler:
+            delete m_sampler;
+            m_sampler = static_cast<Sampler *>(obj);
+            break;
+
+        case ECamera:
+            delete m_camera;
+            m_camera = static_cast<Camera *>(obj);
+            break;
+
+        case EIntegrator:
+            delete m_integrator;
+            m_integrator = static_cast<Integrator *>(obj);
+            break;
+
+        case EDenoiser:
+            delete m_denoiser;
+            m_denoiser = static_cast<Denoiser *>(obj);
+            break;
+
+        default:
+            throw NoriException("Scene::replaceChild(<%s>) is not supported!",
+                classTypeName(obj->getClassType()));
+    }
+    obj->setParent(this);
+}
+
+Color3f Integrator::Li(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                       AOVRecord &aov) const {
+    /* Generic fallback: trace the camera ray once more to find the visible surface */
+    Intersection its;
+    aov.clear();
+    if (scene->rayIntersect(ray, its))
+        aov.setSurface(its);
+    return Li(scene, sampler, ray);
+}
+
 std::string Scene::toString() const {
     std::string meshes;
     for (size_t i=0; i<m_meshes.size(); ++i) {
@@ -102,12 +150,14 @@ std::string Scene::toString() const {
         "  integrator = %s,\n"
         "  sampler = %s\n"
         "  camera = %s,\n"
+        "  denoiser = %s,\n"
         "  meshes = {\n"
         "  %s  }\n"
         "]",
         indent(m_integrator->toString()),
         indent(m_sampler->toString()),
         indent(m_camera->toString()),
+        m_denoiser ? indent(m_denoiser->toString()) : std::string("null"),
         indent(meshes, 2)
     );
 }
@@ -0,0 +1,125 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/block.h>
+#include <nori/bitmap.h>
+#include <nori/rfilter.h>
+#include <nori/sampler.h>
+
+using namespace nori;
+
+/**
+ * Checks that merging the partial images of <tt>nori --shard i/N</tt>
+ * reproduces a single-process render.
+ *
+ * Both renders splat the same synthetic samples (random colors at sample
+ * positions drawn from the sampler) in the same way as the renderer: the
+ * single-process render with a split tail, the shards with the interleaved
+ * block sequence that \c --shard uses. The partial images are merged with
+ * the code of \c nori-merge. Since the samples only depend on the pixel and
+ * the sample index, the results may only differ by the summation order.
+ *
+ * Syntax: shardcheck [width height] [blockSize] [shards] [sampler]
+ */
+
+/// Render all blocks handed out by \c blockGenerator into \c result
+static void render(ImageBlock &result, BlockGenerator &blockGenerator,
+                   const Sampler *sampler, const ReconstructionFilter *filter) {
+    ImageBlock block(Vector2i(blockGenerator.getBlockSize()), filter);
+    std::unique_ptr<Sampler> clone(sampler->clone());
+    uint32_t sampleCount = (uint32_t) sampler->getSampleCount();
+
+    while (blockGenerator.next(block)) {
+        block.clear();
+        clone->prepare(block);
+        Point2i offset = block.getOffset();
+        Vector2i size = block.getSize();
+        for (int y = 0; y < size.y(); ++y) {
+            for (int x = 0; x < size.x(); ++x) {
+                Point2i pixel(x + offset.x(), y + offset.y());
+                clone->generate(pixel);
+                for (uint32_t i = 0; i < sampleCount; ++i) {
+                    Point2f pos = Point2f((float) pixel.x(), (float) pixel.y()) + clone->next2D();
+                    float r = clone->next1D(), g = clone->next1D();
+                    block.put(pos, Color3f(r, g, clone->next1D()));
+                    clone->advance();
+                }
+            }
+        }
+        result.put(block);
+    }
+}
+
+int main(int argc, char **argv) {
+    Vector2i size(203, 117);
+    int blockSize = 16, shards = 3;
+    std::string samplerName = "independent";
+
+    if (argc >= 3)
+        size = Vector2i(atoi(argv[1]), atoi(argv[2]));
+    if (argc >= 4)
+        blockSize = atoi(argv[3]);
+    if (argc >= 5)
+        shards = atoi(argv[4]);
+    if (argc >= 6)
+        samplerName = argv[5];
+
+    if (size.minCoeff() <= 0 || blockSize <= 0 || shards <= 0) {
+        cerr << "Syntax: " << argv[0] << " [width height] [blockSize] [shards] [sampler]" << endl;
+        return -1;
+    }
+
+    try {
+        std::unique_ptr<ReconstructionFilter> filter(static_cast<ReconstructionFilter *>(
+            NoriObjectFactory::createInstance("gaussian", PropertyList())));
+        PropertyList samplerProps;
+        samplerProps.setInteger("sampleCount", 4);
+        std::unique_ptr<Sampler> sampler(static_cast<Sampler *>(
+            NoriObjectFactory::createInstance(samplerName, samplerProps)));
+
+        /* Single process, splitting the last blocks into sub-blocks */
+        ImageBlock single(size, filter.get());
+        single.clear();
+        BlockGenerator singleGenerator(size, blockSize, BlockGenerator::ESpiral, 16);
+        render(single, singleGenerator, sampler.get(), filter.get());
+        std::unique_ptr<Bitmap> reference(single.toBitmap());
+
+        /* Shards, merged like nori-merge does */
+        std::unique_ptr<Bitmap> sum;
+        for (int i = 0; i < shards; ++i) {
+            ImageBlock partial(size, filter.get());
+            partial.clear();
+            BlockGenerator shardGenerator(size, blockSize, BlockGenerator::ESpiral, 0);
+            shardGenerator.shard(i, shards);
+            render(partial, shardGenerator, sampler.get(), filter.get());
+            std::unique_ptr<Bitmap> bitmap(partial.toUnnormalizedBitmap());
+            if (!sum)
+                sum = std::move(bitmap);
+            else if (!sum->accumulate(*bitmap))
+                throw NoriException("The partial images don't match!");
+        }
+        std::unique_ptr<Bitmap> merged(sum->normalize());
+
+        float maxError = 0.0f;
+        for (int y = 0; y < size.y(); ++y)
+            for (int x = 0; x < size.x(); ++x)
+                maxError = std::max(maxError, ((*merged)(y, x) - (*reference)(y, x)).abs().maxCoeff() /
+                    std::max((*reference)(y, x).maxCoeff(), 1e-3f));
+
+        cout << tfm::format("%ix%i pixels, blocks of %i, %i shards, \"%s\" sampler: "
+            "maximum relative difference %g", size.x(), size.y(), blockSize, shards,
+            samplerName, maxError) << endl;
+        if (maxError > 1e-5f) {
+            cerr << "The merged shards don't match the single-process render!" << endl;
+            return -1;
+        }
+    } catch (const std::exception &e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
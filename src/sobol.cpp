@@ -0,0 +1,139 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Sobol sampling - returns the points of a scrambled Sobol sequence
+ *
+ * Every call to \ref next1D() or \ref next2D() uses the next
+ * dimension of a padded sequence: each dimension consists of the
+ * first one or two dimensions of the Sobol sequence, which form a
+ * (0, 2)-sequence in base 2. The points are randomized with Owen
+ * scrambling and the order of the sample indices is shuffled
+ * independently per pixel and dimension (following Burley, "Practical
+ * Hash-based Owen Scrambling", JCGT 2020). This keeps every dimension
+ * well-stratified no matter how many dimensions a path consumes, while
+ * the dimensions remain uncorrelated.
+ *
+ * Since the scrambling and shuffling preserve the stratification of
+ * power-of-two prefixes, the samples of a progressive render remain
+ * well-distributed after every pass with a power-of-two sample count.
+ */
+class Sobol : public Sampler {
+public:
+    Sobol(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~Sobol() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Sobol> cloned(new Sobol());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_pixelSeed = m_pixelSeed;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return cloned;
+    }
+
+    void prepare(const ImageBlock &) { /* No-op for this sampler */ }
+
+    void generate(const Point2i &pixel) {
+        m_pixelSeed = hash(hash(m_seed ^ (uint32_t) pixel.x()) ^ (uint32_t) pixel.y());
+        m_sampleIndex = (uint32_t) m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        m_sampleIndex++;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t seed = hash(m_pixelSeed ^ m_dimension++);
+        uint32_t index = scramble(m_sampleIndex, seed);
+        return toFloat(scramble(reverseBits(index), hash(seed ^ 1)));
+    }
+
+    Point2f next2D() {
+        uint32_t seed = hash(m_pixelSeed ^ m_dimension++);
+        uint32_t index = scramble(m_sampleIndex, seed);
+        return Point2f(
+            toFloat(scramble(reverseBits(index), hash(seed ^ 1))),
+            toFloat(scramble(sobol1(index), hash(seed ^ 2)))
+        );
+    }
+
+    std::string toString() const {
+        return tfm::format("Sobol[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    Sobol() { }
+
+    /// Integer hash function with good avalanche properties
+    static uint32_t hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static uint32_t reverseBits(uint32_t x) {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    /**
+     * \brief Owen scrambling of a 32 bit fixed-point number (as well as
+     * shuffling of a sample index), following Laine and Karras
+     *
+     * The permutation only propagates information from the lower to the
+     * higher bits, hence it is applied to the reversed bits.
+     */
+    static uint32_t scramble(uint32_t x, uint32_t seed) {
+        x = reverseBits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverseBits(x);
+    }
+
+    /// Second dimension of the Sobol sequence (the first one is \ref reverseBits())
+    static uint32_t sobol1(uint32_t index) {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+            if (index & 1)
+                result ^= v;
+        return result;
+    }
+
+    /// Convert a 32 bit fixed-point number to a float in [0, 1)
+    static float toFloat(uint32_t x) {
+        return (x >> 8) * 0x1p-24f;
+    }
+
+private:
+    uint32_t m_seed = 0;
+    uint32_t m_pixelSeed = 0;
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(Sobol, "sobol");
+NORI_NAMESPACE_END
@@ -0,0 +1,163 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+#include <nori/emitter.h>
+#include <nori/sampler.h>
+#include <nori/warp.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Analytic sphere
+ *
+ * Replaces tessellated OBJ spheres by a single primitive with exact
+ * normals. The following parameters are supported:
+ *
+ * - \c center: position of the center (default: origin)
+ * - \c radius: radius of the sphere (default: 1)
+ *
+ * When used as an area emitter, positions are generated by sampling the
+ * cone of directions subtended by the sphere as seen from the reference
+ * point, which has far less variance than uniform area sampling.
+ */
+class Sphere : public Mesh {
+public:
+    Sphere(const PropertyList &propList) {
+        m_center = propList.getPoint("center", Point3f(0.f));
+        m_radius = propList.getFloat("radius", 1.f);
+        if (m_radius <= 0.f)
+            throw NoriException("Sphere: the radius must be positive!");
+
+        m_bbox = BoundingBox3f(m_center - Vector3f::Constant(m_radius),
+                               m_center + Vector3f::Constant(m_radius));
+        m_name = "sphere";
+    }
+
+    uint32_t getPrimitiveCount() const { return 1; }
+
+    float surfaceArea() const { return 4.f * M_PI * m_radius * m_radius; }
+
+    BoundingBox3f getBoundingBox(uint32_t) const { return m_bbox; }
+
+    BoundingBox3f getBoundingBox(uint32_t, float) const { return m_bbox; }
+
+    Point3f getCentroid(uint32_t) const { return m_center; }
+
+    bool rayIntersect(uint32_t, const Ray3f &ray, float &u, float &v, float &t) const {
+        /* Solve |o + t*d - c|^2 = r^2 using the numerically robust
+           formulation from "Precision Improvements for Ray/Sphere
+           Intersection" (Ray Tracing Gems, Chapter 7) */
+        Vector3f f = ray.o - m_center;
+        float a = ray.d.squaredNorm();
+        float b = -f.dot(ray.d);
+        Vector3f l = f + (b / a) * ray.d;
+        float discrim = a * (m_radius * m_radius - l.squaredNorm());
+        if (discrim < 0.f)
+            return false;
+
+        float c = f.squaredNorm() - m_radius * m_radius;
+        float q = b + std::copysign(std::sqrt(discrim), b);
+        float t0 = c / q, t1 = q / a;
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        if (t0 >= ray.mint && t0 <= ray.maxt)
+            t = t0;
+        else if (t1 >= ray.mint && t1 <= ray.maxt)
+            t = t1;
+        else
+            return false;
+
+        u = v = 0.f;
+        return true;
+    }
+
+    void setHitInformation(uint32_t, const Ray3f &ray, Intersection &its) const {
+        /* Reproject the hit onto the surface to reduce the error of ray(t) */
+        Vector3f n = (ray(its.t) - m_center).normalized();
+        its.p = m_center + m_radius * n;
+        its.time = ray.time;
+        its.uv = Point2f(
+            0.5f + std::atan2(n.y(), n.x()) * INV_TWOPI,
+            std::acos(clamp(n.z(), -1.f, 1.f)) * INV_PI);
+        its.geoFrame = its.shFrame = Frame(n);
+    }
+
+    const EmitterQueryRecord sample(Sampler *sampler) const {
+        Vector3f n = Warp::squareToUniformSphere(sampler->next2D());
+        return EmitterQueryRecord(m_center + m_radius * n, n, 1.f / surfaceArea());
+    }
+
+    const EmitterQueryRecord sample(const Point3f &ref, Sampler *sampler) const {
+        Vector3f wc = m_center - ref;
+        float dc2 = wc.squaredNorm();
+        if (dc2 <= m_radius * m_radius)
+            return sample(sampler);
+
+        /* Sample a direction in the cone subtended by the sphere */
+        float dc = std::sqrt(dc2);
+        wc /= dc;
+        float sinThetaMax2 = m_radius * m_radius / dc2;
+        float cosThetaMax = std::sqrt(std::max(0.f, 1.f - sinThetaMax2));
+
+        Point2f sample = sampler->next2D();
+        float cosTheta = (1.f - sample.x()) + sample.x() * cosThetaMax;
+        float sinTheta2 = std::max(0.f, 1.f - cosTheta * cosTheta);
+        float phi = sample.y() * 2.f * M_PI;
+
+        /* Find the point on the sphere that is seen along this direction */
+        float ds = dc * cosTheta - std::sqrt(std::max(0.f, m_radius * m_radius - dc2 * sinTheta2));
+        float cosAlpha = (dc2 + m_radius * m_radius - ds * ds) / (2.f * dc * m_radius);
+        float sinAlpha = std::sqrt(std::max(0.f, 1.f - cosAlpha * cosAlpha));
+
+        Frame frame(wc);
+        Vector3f n = -(sinAlpha * std::cos(phi) * frame.s +
+                       sinAlpha * std::sin(phi) * frame.t +
+                       cosAlpha * frame.n);
+        EmitterQueryRecord eRec(m_center + m_radius * n, n, 0.f);
+        eRec.pdf = pdf(ref, eRec);
+        return eRec;
+    }
+
+    float pdf(const Point3f &ref, const EmitterQueryRecord &eRec) const {
+        float dc2 = (m_center - ref).squaredNorm();
+        if (dc2 <= m_radius * m_radius)
+            return 1.f / surfaceArea();
+
+        /* Uniform density in the cone, converted to the area measure */
+        float cosThetaMax = std::sqrt(std::max(0.f, 1.f - m_radius * m_radius / dc2));
+        float pdfSolidAngle = 1.f / (2.f * M_PI * (1.f - cosThetaMax));
+        Vector3f d = ref - eRec.p;
+        float dist2 = d.squaredNorm();
+        if (dist2 == 0.f)
+            return 0.f;
+        return pdfSolidAngle * std::abs(eRec.n.dot(d)) / (dist2 * std::sqrt(dist2));
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "Sphere[\n"
+            "  center = %s,\n"
+            "  radius = %f,\n"
+            "  bsdf = %s,\n"
+            "  emitter = %s\n"
+            "]",
+            m_center.toString(),
+            m_radius,
+            m_bsdf ? indent(m_bsdf->toString()) : std::string("null"),
+            m_emitter ? indent(m_emitter->toString()) : std::string("null")
+        );
+    }
+
+protected:
+    Point3f m_center;
+    float m_radius;
+};
+
+NORI_REGISTER_CLASS(Sphere, "sphere");
+NORI_NAMESPACE_END
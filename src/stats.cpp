@@ -0,0 +1,115 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/stats.h>
+#include <nori/timer.h>
+#include <nori/bitmap.h>
+#include <fstream>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+thread_local Statistics::ThreadCounters *Statistics::s_local = nullptr;
+std::atomic<uint64_t> Statistics::s_workDone(0);
+std::atomic<uint64_t> Statistics::s_workTotal(0);
+
+/* Counters of all threads that ever added to them (they are never released,
+   since the render threads of TBB live until the end of the program) */
+static tbb::mutex threadsMutex;
+static std::vector<std::unique_ptr<Statistics::ThreadCounters>> &threads() {
+    static std::vector<std::unique_ptr<Statistics::ThreadCounters>> counters;
+    return counters;
+}
+static Timer renderTimer;
+
+Statistics::ThreadCounters *Statistics::registerThread() {
+    ThreadCounters *counters = new ThreadCounters();
+    for (int i = 0; i < ECounterCount; ++i)
+        counters->values[i].store(0, std::memory_order_relaxed);
+
+    tbb::mutex::scoped_lock lock(threadsMutex);
+    threads().emplace_back(counters);
+    return counters;
+}
+
+void Statistics::beginRender(uint64_t workTotal) {
+    tbb::mutex::scoped_lock lock(threadsMutex);
+    s_workDone = 0;
+    s_workTotal = workTotal;
+    renderTimer.reset();
+}
+
+Statistics::Snapshot Statistics::snapshot() {
+    Snapshot result;
+    for (int i = 0; i < ECounterCount; ++i)
+        result.totals[i] = 0;
+
+    tbb::mutex::scoped_lock lock(threadsMutex);
+    result.time = renderTimer.elapsed();
+    for (const auto &counters : threads()) {
+        for (int i = 0; i < ECounterCount; ++i)
+            result.totals[i] += counters->values[i].load(std::memory_order_relaxed);
+        result.busyTime.push_back(counters->values[EBusyTime].load(std::memory_order_relaxed));
+    }
+    result.workDone = s_workDone.load(std::memory_order_relaxed);
+    result.workTotal = s_workTotal.load(std::memory_order_relaxed);
+    return result;
+}
+
+void TileStatistics::put(const Point2i &offset, const Vector2i &size, double time,
+                         uint64_t samples, uint64_t closestHitRays, uint64_t shadowRays) {
+    tbb::mutex::scoped_lock lock(m_mutex);
+    Tile &tile = m_tiles[std::make_pair(offset.y(), offset.x())];
+    tile.size = size;
+    tile.time += time;
+    tile.samples += samples;
+    tile.closestHitRays += closestHitRays;
+    tile.shadowRays += shadowRays;
+}
+
+Bitmap *TileStatistics::toBitmap(const Vector2i &size) const {
+    Bitmap *result = new Bitmap(size);
+    result->setConstant(Color3f(0.0f));
+    for (const char *name : { "samples", "closestHitRays", "shadowRays" })
+        result->addChannel(name).data.setZero();
+    auto &samples = result->getChannels()[0].data;
+    auto &closestHitRays = result->getChannels()[1].data;
+    auto &shadowRays = result->getChannels()[2].data;
+
+    tbb::mutex::scoped_lock lock(m_mutex);
+    for (const auto &entry : m_tiles) {
+        const Tile &tile = entry.second;
+        int y0 = entry.first.first, x0 = entry.first.second;
+        float pixels = (float) tile.size.prod();
+        for (int y = std::max(y0, 0); y < std::min(y0 + tile.size.y(), size.y()); ++y) {
+            for (int x = std::max(x0, 0); x < std::min(x0 + tile.size.x(), size.x()); ++x) {
+                result->coeffRef(y, x) = Color3f((float) tile.time * 1000.0f / pixels);
+                samples(y, x) = tile.samples / pixels;
+                closestHitRays(y, x) = tile.closestHitRays / pixels;
+                shadowRays(y, x) = tile.shadowRays / pixels;
+            }
+        }
+    }
+    return result;
+}
+
+void TileStatistics::saveCSV(const std::string &filename) const {
+    std::ofstream file(filename);
+    file << "x,y,width,height,time_ms,samples,closest_hit_rays,shadow_rays" << endl;
+
+    tbb::mutex::scoped_lock lock(m_mutex);
+    for (const auto &entry : m_tiles) {
+        const Tile &tile = entry.second;
+        file << entry.first.second << "," << entry.first.first << ","
+             << tile.size.x() << "," << tile.size.y() << ","
+             << tfm::format("%.3f", tile.time) << "," << tile.samples << ","
+             << tile.closestHitRays << "," << tile.shadowRays << endl;
+    }
+    if (!file)
+        throw NoriException("Could not write \"%s\"!", filename);
+}
+
+NORI_NAMESPACE_END
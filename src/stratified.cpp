@@ -0,0 +1,210 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Stratified sampling - returns jittered samples from a set of
+ * \c sampleCount strata per pixel
+ *
+ * One-dimensional components are stratified into \c sampleCount
+ * intervals, two-dimensional ones into a grid of roughly square cells.
+ * The assignment of strata to samples is shuffled independently per
+ * pixel and dimension ("dimension shuffling"), so that subsequent
+ * components don't correlate. Nothing is precomputed: the shuffled
+ * strata are evaluated on the fly using hash-based permutations
+ * (Kensler, "Correlated Multi-Jittered Sampling", 2013), hence the
+ * memory usage doesn't depend on the image size or sample count.
+ *
+ * Every \c sampleCount consecutive samples of a pixel form a stratified
+ * set. Further samples (e.g. in later passes of a progressive render)
+ * use new sets.
+ */
+class Stratified : public Sampler {
+public:
+    Stratified(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+        if (m_sampleCount == 0)
+            throw NoriException("The sampler's 'sampleCount' must be positive!");
+        configure();
+    }
+
+    virtual ~Stratified() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Stratified> cloned(create());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_pixelSeed = m_pixelSeed;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        cloned->configure();
+        return cloned;
+    }
+
+    void prepare(const ImageBlock &) { /* No-op for this sampler */ }
+
+    void generate(const Point2i &pixel) {
+        m_pixelSeed = hash(hash(m_seed ^ (uint32_t) pixel.x()) ^ (uint32_t) pixel.y());
+        m_sampleIndex = m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        m_sampleIndex++;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t p = nextPattern(), s = sampleInSet();
+        return toUnit((permute(s, m_setSize, p) + randfloat(s, p * 0x68bc21ebu)) / m_setSize);
+    }
+
+    Point2f next2D() {
+        uint32_t p = nextPattern(), s = sampleInSet();
+        uint32_t cell = permute(s, m_cols * m_rows, p);
+        return Point2f(
+            toUnit((cell % m_cols + randfloat(s, p * 0x967a889bu)) / m_cols),
+            toUnit((cell / m_cols + randfloat(s, p * 0x368cc8b7u)) / m_rows)
+        );
+    }
+
+    std::string toString() const {
+        return tfm::format("%s[sampleCount=%i, seed=%i]", getName(), m_sampleCount, m_seed);
+    }
+protected:
+    Stratified() { }
+
+    /// Create an instance of the same class (used by \ref clone())
+    virtual Stratified *create() const { return new Stratified(); }
+
+    /// Return the class name (used in messages)
+    virtual const char *getName() const { return "Stratified"; }
+
+    /// Compute the size of the sample sets and of the 2D grid
+    void configure() {
+        m_setSize = (uint32_t) m_sampleCount;
+        m_cols = std::max(1u, (uint32_t) std::sqrt((float) m_setSize));
+        m_rows = (m_setSize + m_cols - 1) / m_cols;
+    }
+
+    /// Return the seed of the pattern of the next dimension
+    uint32_t nextPattern() {
+        uint32_t set = (uint32_t) (m_sampleIndex / m_setSize);
+        return hash(m_pixelSeed ^ hash(m_dimension++ ^ hash(set)));
+    }
+
+    /// Return the index of the current sample within its set
+    uint32_t sampleInSet() const {
+        return (uint32_t) (m_sampleIndex % m_setSize);
+    }
+
+    /// Integer hash function with good avalanche properties
+    static uint32_t hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    /// Return element \c i of a random permutation of <tt>[0, l)</tt> selected by \c p (Kensler)
+    static uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+        uint32_t w = l - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do {
+            i ^= p; i *= 0xe170893du;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8; i *= 0x0929eb3fu;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1; i *= 1 | p >> 27;
+            i *= 0x6935fa69u;
+            i ^= (i & w) >> 11; i *= 0x74dcb303u;
+            i ^= (i & w) >> 2; i *= 0x9e501cc3u;
+            i ^= (i & w) >> 2; i *= 0xc860a3dfu;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= l);
+        return (i + p) % l;
+    }
+
+    /// Return a random number in <tt>[0, 1)</tt> determined by \c i and \c p (Kensler)
+    static double randfloat(uint32_t i, uint32_t p) {
+        i ^= p;
+        i ^= i >> 17;
+        i ^= i >> 10; i *= 0xb36534e5u;
+        i ^= i >> 12;
+        i ^= i >> 21; i *= 0x93fc4795u;
+        i ^= 0xdf6e307fu;
+        i ^= i >> 17; i *= 1 | p >> 18;
+        return i * (1.0 / 4294967808.0);
+    }
+
+    /// Convert to a float in <tt>[0, 1)</tt>, rounding down so that no sample leaves its stratum
+    static float toUnit(double value) {
+        float result = (float) value;
+        if (result > value)
+            result = std::nextafter(result, 0.0f);
+        return std::min(result, 0x1.fffffep-1f);
+    }
+
+protected:
+    uint32_t m_seed = 0;
+    uint32_t m_pixelSeed = 0;
+    uint64_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+    uint32_t m_setSize = 1, m_cols = 1, m_rows = 1;
+};
+
+/**
+ * Correlated multi-jittered sampling (Kensler 2013)
+ *
+ * Like \ref Stratified, but the 2D components are multi-jittered: the
+ * samples are stratified in the cells of the grid and, at the same time,
+ * in as many intervals along each axis as the grid has cells (which is
+ * \c sampleCount if it factors into the grid, e.g. 16 = 4x4 or 12 = 3x4).
+ * Correlating the shuffles of the rows and columns further reduces the
+ * discrepancy. This gives a considerably lower error than jittered
+ * sampling at low sample counts.
+ */
+class CorrelatedMultiJittered : public Stratified {
+public:
+    CorrelatedMultiJittered(const PropertyList &propList) : Stratified(propList) { }
+
+    Point2f next2D() {
+        uint32_t p = nextPattern();
+        uint32_t s = permute(sampleInSet(), m_setSize, p * 0x51633e2du);
+        uint32_t sx = permute(s % m_cols, m_cols, p * 0x68bc21ebu);
+        uint32_t sy = permute(s / m_cols, m_rows, p * 0x02e5be93u);
+        double jx = randfloat(s, p * 0x967a889bu);
+        double jy = randfloat(s, p * 0x368cc8b7u);
+        return Point2f(
+            toUnit((s % m_cols + (sy + jx) / m_rows) / m_cols),
+            toUnit((s / m_cols + (sx + jy) / m_cols) / m_rows)
+        );
+    }
+
+protected:
+    CorrelatedMultiJittered() { }
+
+    Stratified *create() const { return new CorrelatedMultiJittered(); }
+
+    const char *getName() const { return "CorrelatedMultiJittered"; }
+};
+
+NORI_REGISTER_CLASS(Stratified, "stratified");
+NORI_REGISTER_CLASS(CorrelatedMultiJittered, "cmj");
+NORI_NAMESPACE_END
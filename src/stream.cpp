@@ -0,0 +1,188 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/stream.h>
+#include <nori/bitmap.h>
+#include <ImfTiledOutputFile.h>
+#include <ImfChannelList.h>
+#include <ImfStringAttribute.h>
+#include <ImfFrameBuffer.h>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+StreamingFramebuffer::StreamingFramebuffer(const std::string &filename, const Vector2i &imageSize,
+        const Point2i &offset, const Vector2i &size, int tileSize,
+        const ReconstructionFilter *filter, const AOVList &aovs,
+        Bitmap::ECompression compression, const std::vector<std::string> &halfChannels)
+        : m_offset(offset), m_size(size), m_tileSize(tileSize), m_filter(filter), m_aovs(aovs) {
+    m_numTiles = Vector2i(
+        (size.x() + tileSize - 1) / tileSize,
+        (size.y() + tileSize - 1) / tileSize);
+
+    /* A block contributes to the tiles within the border size of the filter */
+    int borderSize = ImageBlock(Vector2i(1), filter).getBorderSize();
+    m_reach = (borderSize + tileSize - 1) / tileSize;
+
+    int tileCount = m_numTiles.x() * m_numTiles.y();
+    m_pending.resize(tileCount);
+    m_written.resize(tileCount, 0);
+    for (int y = 0; y < m_numTiles.y(); ++y) {
+        for (int x = 0; x < m_numTiles.x(); ++x) {
+            int nx = std::min(x + m_reach, m_numTiles.x() - 1) - std::max(x - m_reach, 0) + 1;
+            int ny = std::min(y + m_reach, m_numTiles.y() - 1) - std::max(y - m_reach, 0) + 1;
+            m_pending[y * m_numTiles.x() + x] = nx * ny;
+        }
+    }
+
+    cout << "Streaming a " << size.x() << "x" << size.y() << " tiled OpenEXR file to \""
+         << filename << "\"" << endl;
+
+    Imath::Box2i displayWindow(Imath::V2i(0, 0), Imath::V2i(imageSize.x() - 1, imageSize.y() - 1));
+    Imath::Box2i dataWindow(Imath::V2i(offset.x(), offset.y()),
+        Imath::V2i(offset.x() + size.x() - 1, offset.y() + size.y() - 1));
+    Imf::Header header(displayWindow, dataWindow);
+    header.insert("comments", Imf::StringAttribute("Generated by Nori"));
+    header.setTileDescription(Imf::TileDescription(tileSize, tileSize, Imf::ONE_LEVEL));
+    header.lineOrder() = Imf::RANDOM_Y;
+    switch (compression) {
+        case Bitmap::ENoCompression: header.compression() = Imf::NO_COMPRESSION; break;
+        case Bitmap::EZIP: header.compression() = Imf::ZIP_COMPRESSION; break;
+        case Bitmap::EPIZ: header.compression() = Imf::PIZ_COMPRESSION; break;
+        case Bitmap::EDWAA: header.compression() = Imf::DWAA_COMPRESSION; break;
+    }
+
+    auto type = [&](const std::string &name) {
+        return std::find(halfChannels.begin(), halfChannels.end(), name) != halfChannels.end()
+            ? Imf::HALF : Imf::FLOAT;
+    };
+    Imf::ChannelList &channels = header.channels();
+    channels.insert("R", Imf::Channel(type("R")));
+    channels.insert("G", Imf::Channel(type("G")));
+    channels.insert("B", Imf::Channel(type("B")));
+    for (const std::string &name : aovs.getChannelNames())
+        channels.insert(name, Imf::Channel(type(name)));
+
+    m_file.reset(new Imf::TiledOutputFile(filename.c_str(), header));
+}
+
+StreamingFramebuffer::~StreamingFramebuffer() {
+    try {
+        finish();
+    } catch (const std::exception &e) {
+        cerr << "StreamingFramebuffer: could not write the remaining tiles: " << e.what() << endl;
+    }
+}
+
+size_t StreamingFramebuffer::getTileMemory() const {
+    ImageBlock block(Vector2i(m_tileSize), m_filter, m_aovs);
+    return (size_t) block.size() * (sizeof(Color4f) + m_aovs.getChannelCount() * sizeof(float));
+}
+
+StreamingFramebuffer::Tile *StreamingFramebuffer::acquire(int index) {
+    tbb::mutex::scoped_lock lock(m_mutex);
+    std::unique_ptr<Tile> &tile = m_tiles[index];
+    if (!tile) {
+        Point2i offset = m_offset + Vector2i(index % m_numTiles.x(), index / m_numTiles.x()) * m_tileSize;
+        Vector2i size = (m_offset + m_size - offset).cwiseMin(Vector2i::Constant(m_tileSize));
+        tile.reset(new Tile(size, m_filter, m_aovs));
+        tile->block.setOffset(offset);
+        tile->block.clear();
+        m_peakTiles = std::max(m_peakTiles, m_tiles.size());
+    }
+    return tile.get();
+}
+
+void StreamingFramebuffer::put(const ImageBlock &block) {
+    Point2i tile = (block.getOffset() - m_offset) / m_tileSize;
+    std::vector<int> affected;
+    for (int y = std::max(tile.y() - m_reach, 0); y <= std::min(tile.y() + m_reach, m_numTiles.y() - 1); ++y)
+        for (int x = std::max(tile.x() - m_reach, 0); x <= std::min(tile.x() + m_reach, m_numTiles.x() - 1); ++x)
+            affected.push_back(y * m_numTiles.x() + x);
+
+    /* Add the contributions to all affected tiles */
+    for (int index : affected) {
+        Tile *t = acquire(index);
+        tbb::spin_mutex::scoped_lock lock(t->mutex);
+        t->block.add(block);
+    }
+
+    /* Release the tiles that no further block contributes to */
+    std::vector<std::pair<int, std::unique_ptr<Tile>>> complete;
+    {
+        tbb::mutex::scoped_lock lock(m_mutex);
+        for (int index : affected) {
+            if (--m_pending[index] > 0)
+                continue;
+            auto it = m_tiles.find(index);
+            complete.emplace_back(index, std::move(it->second));
+            m_tiles.erase(it);
+            m_written[index] = 1;
+        }
+    }
+
+    for (auto &t : complete)
+        write(t.first, t.second->block);
+}
+
+void StreamingFramebuffer::finish() {
+    if (!m_file)
+        return;
+
+    std::map<int, std::unique_ptr<Tile>> tiles;
+    {
+        tbb::mutex::scoped_lock lock(m_mutex);
+        tiles.swap(m_tiles);
+    }
+
+    /* Tiles that never received any samples are written as zero */
+    for (int index = 0; index < (int) m_written.size(); ++index) {
+        if (m_written[index])
+            continue;
+        auto it = tiles.find(index);
+        if (it != tiles.end()) {
+            write(index, it->second->block);
+        } else {
+            Point2i offset = m_offset + Vector2i(index % m_numTiles.x(), index / m_numTiles.x()) * m_tileSize;
+            ImageBlock block((m_offset + m_size - offset).cwiseMin(Vector2i::Constant(m_tileSize)),
+                             m_filter, m_aovs);
+            block.setOffset(offset);
+            block.clear();
+            write(index, block);
+        }
+        m_written[index] = 1;
+    }
+
+    m_file.reset();
+}
+
+void StreamingFramebuffer::write(int index, const ImageBlock &block) {
+    std::unique_ptr<Bitmap> bitmap(block.toBitmap());
+    Point2i origin = block.getOffset();
+
+    /* OpenEXR addresses the frame buffer using absolute pixel coordinates */
+    size_t compStride = sizeof(float),
+           pixelStride = 3 * compStride,
+           rowStride = pixelStride * bitmap->cols();
+    char *ptr = reinterpret_cast<char *>(bitmap->data())
+        - origin.x() * pixelStride - origin.y() * rowStride;
+
+    Imf::FrameBuffer frameBuffer;
+    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+    for (const Bitmap::Channel &channel : bitmap->getChannels()) {
+        char *data = reinterpret_cast<char *>(const_cast<float *>(channel.data.data()))
+            - origin.x() * compStride - origin.y() * compStride * bitmap->cols();
+        frameBuffer.insert(channel.name, Imf::Slice(Imf::FLOAT, data, compStride, compStride * bitmap->cols()));
+    }
+
+    tbb::mutex::scoped_lock lock(m_fileMutex);
+    m_file->setFrameBuffer(frameBuffer);
+    m_file->writeTile(index % m_numTiles.x(), index / m_numTiles.x());
+}
+
+NORI_NAMESPACE_END